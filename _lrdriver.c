@@ -0,0 +1,645 @@
+/*
+ * The shift/reduce loop of lrdriver.py in C.
+ *
+ * load() copies the flattened tables of an lrdriver.Tables
+ * into C arrays held by a capsule, and parse() runs the loop
+ * over them, calling back into Python only for the
+ * reductions that have an action. trace() only follows the
+ * tables, for lrdriver.parse_chunked(). All of them follow
+ * the encoding of lrdriver.py.
+ */
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#define EOI	'$'
+
+enum act_kind {
+	NO_ACT,		ACT_SHIFT,
+	ACT_REDUCE,	ACT_ACCEPT,
+	ACT_ERROR,	ACT_SHIFT_REDUCE,
+};
+#define KIND_BITS	3
+#define ACT_KIND(A)	((A) & ((1L << KIND_BITS) - 1))
+#define ACT_ARG(A)	((A) >> KIND_BITS)
+
+struct lr_tabs {
+	Py_ssize_t states_n, classes_n, nts_n, prods_n, class_map_n;
+	long *acts;		/* states_n * classes_n */
+	long *dflts;		/* states_n */
+	long *lr0_red;		/* states_n */
+	long *gotos;		/* states_n * nts_n, -1 if none */
+	long *class_map;	/* token type -> class, -1 if none */
+	long *prod_len;		/* prods_n */
+	long *prod_head;	/* prods_n */
+};
+
+#define CAPSULE_NAME	"_lrdriver.tabs"
+
+void free_lr_tabs(struct lr_tabs *t)
+{
+	PyMem_Free(t->acts);
+	PyMem_Free(t->dflts);
+	PyMem_Free(t->lr0_red);
+	PyMem_Free(t->gotos);
+	PyMem_Free(t->class_map);
+	PyMem_Free(t->prod_len);
+	PyMem_Free(t->prod_head);
+	PyMem_Free(t);
+}
+
+void lr_destroy_capsule(PyObject *cap)
+{
+	free_lr_tabs(PyCapsule_GetPointer(cap, CAPSULE_NAME));
+}
+
+/*
+ * Sets *arr to a new array with the ints of the sequence seq
+ * and *n to its length. Returns -1 with an exception set
+ * and *arr set to NULL on failure.
+ */
+int lr_long_array(PyObject *seq, long **arr, Py_ssize_t *n)
+{
+	*arr = NULL;
+	PyObject *fast = PySequence_Fast(seq, "expected a sequence of ints");
+	if (fast == NULL)
+		return -1;
+	*n = PySequence_Fast_GET_SIZE(fast);
+	*arr = PyMem_Malloc((size_t) (*n > 0 ? *n : 1) * sizeof(long));
+	if (*arr == NULL) {
+		Py_DECREF(fast);
+		PyErr_NoMemory();
+		return -1;
+	}
+	PyObject **items = PySequence_Fast_ITEMS(fast);
+	for (Py_ssize_t i = 0; i < *n; i++) {
+		(*arr)[i] = PyLong_AsLong(items[i]);
+		if ((*arr)[i] == -1 && PyErr_Occurred()) {
+			Py_DECREF(fast);
+			PyMem_Free(*arr);
+			*arr = NULL;
+			return -1;
+		}
+	}
+	Py_DECREF(fast);
+	return 0;
+}
+
+PyObject *lrdriver_load(PyObject *self, PyObject *args)
+{
+	(void) self;
+	PyObject *acts, *dflts, *lr0_red, *gotos, *class_map;
+	PyObject *prod_len, *prod_head;
+	Py_ssize_t classes_n, nts_n, n;
+	if (!PyArg_ParseTuple(args, "OOOOOOOnn", &acts, &dflts, &lr0_red,
+			&gotos, &class_map, &prod_len, &prod_head,
+			&classes_n, &nts_n))
+		return NULL;
+
+	struct lr_tabs *t = PyMem_Calloc(1, sizeof(struct lr_tabs));
+	if (t == NULL)
+		return PyErr_NoMemory();
+	t->classes_n = classes_n;
+	t->nts_n = nts_n;
+	if (lr_long_array(acts, &t->acts, &n) < 0 ||
+		lr_long_array(dflts, &t->dflts, &t->states_n) < 0 ||
+		lr_long_array(lr0_red, &t->lr0_red, &n) < 0 ||
+		lr_long_array(gotos, &t->gotos, &n) < 0 ||
+		lr_long_array(class_map, &t->class_map, &t->class_map_n) < 0 ||
+		lr_long_array(prod_len, &t->prod_len, &t->prods_n) < 0 ||
+		lr_long_array(prod_head, &t->prod_head, &n) < 0) {
+		free_lr_tabs(t);
+		return NULL;
+	}
+
+	PyObject *cap = PyCapsule_New(t, CAPSULE_NAME, lr_destroy_capsule);
+	if (cap == NULL)
+		free_lr_tabs(t);
+	return cap;
+}
+
+/* The parse stack: a state and a value (a new reference) per entry. */
+struct lr_stack {
+	long *states;
+	PyObject **vals;
+	Py_ssize_t n, cap;
+};
+
+int lr_push(struct lr_stack *st, long state, PyObject *val)
+{
+	if (st->n == st->cap) {
+		Py_ssize_t cap = st->cap ? 2*st->cap : 64;
+		long *states = PyMem_Realloc(st->states,
+					(size_t) cap * sizeof(long));
+		if (states == NULL)
+			goto no_mem;
+		st->states = states;
+		PyObject **vals = PyMem_Realloc(st->vals,
+					(size_t) cap * sizeof(PyObject *));
+		if (vals == NULL)
+			goto no_mem;
+		st->vals = vals;
+		st->cap = cap;
+	}
+	st->states[st->n] = state;
+	st->vals[st->n++] = val;
+	return 0;
+no_mem:
+	Py_DECREF(val);
+	PyErr_NoMemory();
+	return -1;
+}
+
+void lr_free_stack(struct lr_stack *st)
+{
+	for (Py_ssize_t i = 0; i < st->n; i++)
+		Py_DECREF(st->vals[i]);
+	PyMem_Free(st->states);
+	PyMem_Free(st->vals);
+}
+
+/*
+ * Reads the next (type, value) pair from it into *type and
+ * *val (a new reference), or EOI and "" at the end of it.
+ * Returns -1 with an exception set on failure.
+ */
+int lr_next_token(PyObject *it, long *type, PyObject **val)
+{
+	PyObject *tk = PyIter_Next(it);
+	if (tk == NULL) {
+		if (PyErr_Occurred())
+			return -1;
+		*type = EOI;
+		*val = PyUnicode_FromString("");
+		return *val == NULL ? -1 : 0;
+	}
+	PyObject *tp, *v;
+	if (PyTuple_Check(tk) && PyTuple_GET_SIZE(tk) == 2) {
+		tp = PyTuple_GET_ITEM(tk, 0);
+		v = PyTuple_GET_ITEM(tk, 1);
+	} else {
+		Py_DECREF(tk);
+		PyErr_SetString(PyExc_TypeError,
+				"tokens must be (type, value) tuples");
+		return -1;
+	}
+	*type = PyLong_AsLong(tp);
+	if (*type == -1 && PyErr_Occurred()) {
+		Py_DECREF(tk);
+		return -1;
+	}
+	Py_INCREF(v);
+	*val = v;
+	Py_DECREF(tk);
+	return 0;
+}
+
+/*
+ * Pops the n values of a production body off st and returns
+ * the value of its head (a new reference): the result of
+ * action if it is not None, the value of the first symbol
+ * of the body otherwise. A last value that is not NULL is the
+ * value of the last symbol, shifted but never pushed, and
+ * its reference is taken.
+ */
+PyObject *lr_reduce(struct lr_stack *st, long n, PyObject *last,
+							PyObject *action)
+{
+	long m = last != NULL ? n - 1 : n;
+	PyObject *val;
+	if (action != Py_None) {
+		PyObject *body = PyTuple_New(n);
+		if (body == NULL) {
+			Py_XDECREF(last);
+			return NULL;
+		}
+		/* the tuple takes the references of the stack */
+		for (long k = 0; k < m; k++)
+			PyTuple_SET_ITEM(body, k, st->vals[st->n - m + k]);
+		if (last != NULL)
+			PyTuple_SET_ITEM(body, m, last);
+		st->n -= m;
+		val = PyObject_Call(action, body, NULL);
+		Py_DECREF(body);
+		return val;
+	}
+	if (n == 0) {
+		Py_INCREF(Py_None);
+		return Py_None;
+	}
+	if (m == 0)
+		return last;
+	val = st->vals[st->n - m];
+	for (long k = 1; k < m; k++)
+		Py_DECREF(st->vals[st->n - m + k]);
+	Py_XDECREF(last);
+	st->n -= m;
+	return val;
+}
+
+/* Returns the action of state s on a token of type tk_type. */
+long lr_lookup_act(struct lr_tabs *t, long s, long tk_type)
+{
+	long c = -1, act = NO_ACT;
+	if (tk_type >= 0 && tk_type < t->class_map_n)
+		c = t->class_map[tk_type];
+	if (c >= 0)
+		act = t->acts[s * t->classes_n + c];
+	return act == NO_ACT ? t->dflts[s] : act;
+}
+
+/* A parser running over one stream of tokens. */
+struct lr_parser {
+	struct lr_stack st;
+	PyObject *it;		/* the tokens, NULL once done */
+	PyObject *tk_val;	/* the lookahead, NULL if not read */
+	long tk_type;
+};
+
+enum step_res {
+	STEP_FAIL = -1,	STEP_MORE,
+	STEP_ACCEPT,	STEP_SYNTAX_ERR,
+};
+
+/*
+ * Starts p on the iterable tokens, reusing its stack.
+ * Returns -1 with an exception set on failure.
+ */
+int lr_start_parser(struct lr_parser *p, long start_state, PyObject *tokens)
+{
+	for (Py_ssize_t i = 0; i < p->st.n; i++)
+		Py_DECREF(p->st.vals[i]);
+	p->st.n = 0;
+	Py_CLEAR(p->tk_val);
+	Py_CLEAR(p->it);
+	p->it = PyObject_GetIter(tokens);
+	if (p->it == NULL)
+		return -1;
+	Py_INCREF(Py_None);
+	return lr_push(&p->st, start_state, Py_None);
+}
+
+void lr_free_parser(struct lr_parser *p)
+{
+	lr_free_stack(&p->st);
+	Py_XDECREF(p->tk_val);
+	Py_XDECREF(p->it);
+}
+
+/*
+ * Performs the next action of p. On the accept, sets *result
+ * to the value of the start symbol (a new reference).
+ */
+enum step_res lr_step(struct lr_tabs *t, struct lr_parser *p, PyObject *acts,
+							PyObject **result)
+{
+	struct lr_stack *st = &p->st;
+	long s = st->states[st->n - 1], act;
+	/* LR(0) reduce states do not need the lookahead,
+	 * so the next token is only read when it is needed.
+	 */
+	if (t->lr0_red[s]) {
+		act = t->dflts[s];
+	} else {
+		if (p->tk_val == NULL && lr_next_token(p->it, &p->tk_type,
+							&p->tk_val) < 0)
+			return STEP_FAIL;
+		act = lr_lookup_act(t, s, p->tk_type);
+	}
+
+	long arg = ACT_ARG(act);
+	switch (ACT_KIND(act)) {
+	case ACT_SHIFT: {
+		PyObject *val = p->tk_val;
+		p->tk_val = NULL;
+		return lr_push(st, arg, val) < 0 ? STEP_FAIL : STEP_MORE;
+	}
+	case ACT_SHIFT_REDUCE:
+	case ACT_REDUCE: {
+		PyObject *last = NULL;
+		if (ACT_KIND(act) == ACT_SHIFT_REDUCE) {
+			last = p->tk_val;
+			p->tk_val = NULL;
+		}
+		PyObject *val = lr_reduce(st, t->prod_len[arg], last,
+				PySequence_Fast_GET_ITEM(acts, arg));
+		if (val == NULL)
+			return STEP_FAIL;
+		long g = t->gotos[st->states[st->n - 1] * t->nts_n +
+							t->prod_head[arg]];
+		return lr_push(st, g, val) < 0 ? STEP_FAIL : STEP_MORE;
+	}
+	case ACT_ACCEPT:
+		*result = st->vals[st->n - 1];
+		Py_INCREF(*result);
+		return STEP_ACCEPT;
+	default:
+		return STEP_SYNTAX_ERR;
+	}
+}
+
+/* Returns the exception raised for a syntax error of p (a new reference). */
+PyObject *lr_syntax_error(struct lr_parser *p)
+{
+	return PyObject_CallFunction(PyExc_Exception, "sl",
+				"Can not handle token", p->tk_type);
+}
+
+/*
+ * Returns the actions as a sequence with one per production,
+ * or NULL with an exception set.
+ */
+PyObject *lr_action_seq(struct lr_tabs *t, PyObject *actions)
+{
+	PyObject *acts = PySequence_Fast(actions, "expected a list of actions");
+	if (acts != NULL && PySequence_Fast_GET_SIZE(acts) != t->prods_n) {
+		Py_DECREF(acts);
+		PyErr_SetString(PyExc_ValueError, "one action per production");
+		return NULL;
+	}
+	return acts;
+}
+
+PyObject *lrdriver_parse(PyObject *self, PyObject *args)
+{
+	(void) self;
+	PyObject *cap, *tokens, *actions;
+	long start_state;
+	if (!PyArg_ParseTuple(args, "OlOO", &cap, &start_state, &tokens,
+								&actions))
+		return NULL;
+	struct lr_tabs *t = PyCapsule_GetPointer(cap, CAPSULE_NAME);
+	if (t == NULL)
+		return NULL;
+	PyObject *acts = lr_action_seq(t, actions);
+	if (acts == NULL)
+		return NULL;
+
+	struct lr_parser p = {{NULL, NULL, 0, 0}, NULL, NULL, EOI};
+	PyObject *result = NULL;
+	enum step_res r = STEP_FAIL;
+	if (lr_start_parser(&p, start_state, tokens) == 0)
+		while ((r = lr_step(t, &p, acts, &result)) == STEP_MORE)
+			;
+	if (r == STEP_SYNTAX_ERR) {
+		PyObject *err = lr_syntax_error(&p);
+		if (err != NULL) {
+			PyErr_SetObject(PyExc_Exception, err);
+			Py_DECREF(err);
+		}
+	}
+	lr_free_parser(&p);
+	Py_DECREF(acts);
+	return result;
+}
+
+/*
+ * Parses every iterable of tokens in streams and returns the
+ * list of their results: the value of the start symbol, or
+ * the exception for a syntax error. lanes parsers advance in
+ * lockstep, one action each in turn, so that the table loads
+ * of different streams overlap. A parser that finishes takes
+ * the next stream with the stack it has.
+ */
+PyObject *lrdriver_parse_batch(PyObject *self, PyObject *args)
+{
+	(void) self;
+	PyObject *cap, *streams, *actions;
+	long start_state;
+	Py_ssize_t lanes;
+	if (!PyArg_ParseTuple(args, "OlOOn", &cap, &start_state, &streams,
+							&actions, &lanes))
+		return NULL;
+	struct lr_tabs *t = PyCapsule_GetPointer(cap, CAPSULE_NAME);
+	if (t == NULL)
+		return NULL;
+	PyObject *acts = lr_action_seq(t, actions);
+	if (acts == NULL)
+		return NULL;
+	PyObject *strs = PySequence_Fast(streams, "expected a list of streams");
+	if (strs == NULL) {
+		Py_DECREF(acts);
+		return NULL;
+	}
+	Py_ssize_t n = PySequence_Fast_GET_SIZE(strs);
+	if (lanes < 1)
+		lanes = 1;
+	if (lanes > n)
+		lanes = n > 0 ? n : 1;
+
+	PyObject *results = PyList_New(n);
+	struct lr_parser *ps = PyMem_Calloc((size_t) lanes,
+					sizeof(struct lr_parser));
+	/* lane l parses the stream at cur[l], or -1 if idle */
+	Py_ssize_t *cur = PyMem_Malloc((size_t) lanes * sizeof(Py_ssize_t));
+	if (results == NULL || ps == NULL || cur == NULL) {
+		if (results != NULL)
+			PyErr_NoMemory();
+		Py_CLEAR(results);
+		goto out;
+	}
+	Py_ssize_t next = 0, busy = 0;
+	for (Py_ssize_t l = 0; l < lanes; l++) {
+		cur[l] = -1;
+		if (next == n)
+			continue;
+		if (lr_start_parser(&ps[l], start_state,
+				PySequence_Fast_GET_ITEM(strs, next)) < 0) {
+			Py_CLEAR(results);
+			goto out;
+		}
+		cur[l] = next++;
+		++busy;
+	}
+	while (busy > 0) {
+		for (Py_ssize_t l = 0; l < lanes; l++) {
+			if (cur[l] < 0)
+				continue;
+			PyObject *res = NULL;
+			enum step_res r = lr_step(t, &ps[l], acts, &res);
+			if (r == STEP_MORE)
+				continue;
+			if (r == STEP_SYNTAX_ERR)
+				res = lr_syntax_error(&ps[l]);
+			if (res == NULL) {
+				Py_CLEAR(results);
+				goto out;
+			}
+			PyList_SET_ITEM(results, cur[l], res);
+			cur[l] = -1;
+			--busy;
+			if (next == n)
+				continue;
+			if (lr_start_parser(&ps[l], start_state,
+				PySequence_Fast_GET_ITEM(strs, next)) < 0) {
+				Py_CLEAR(results);
+				goto out;
+			}
+			cur[l] = next++;
+			++busy;
+		}
+	}
+out:
+	if (ps != NULL)
+		for (Py_ssize_t l = 0; l < lanes; l++)
+			lr_free_parser(&ps[l]);
+	PyMem_Free(ps);
+	PyMem_Free(cur);
+	Py_DECREF(strs);
+	Py_DECREF(acts);
+	return results;
+}
+
+/* Appends ev to the events *evs, returning -1 if out of memory. */
+int lr_add_event(long **evs, Py_ssize_t *n, Py_ssize_t *cap, long ev)
+{
+	if (*n == *cap) {
+		*cap = 2 * *cap + 1024;
+		long *nevs = PyMem_Realloc(*evs, (size_t) *cap * sizeof(long));
+		if (nevs == NULL) {
+			PyErr_NoMemory();
+			return -1;
+		}
+		*evs = nevs;
+	}
+	(*evs)[(*n)++] = ev;
+	return 0;
+}
+
+/*
+ * Runs the parser from the stack of states over the token
+ * types and returns the events, -1 for a shift and the
+ * production for a reduction, as the bytes of an array of
+ * longs, and the stack once it needs
+ * a token past the last one. With final set the input ends
+ * there, and the run stops at the accept instead.
+ * Returns None on a syntax error.
+ */
+PyObject *lrdriver_trace(PyObject *self, PyObject *args)
+{
+	(void) self;
+	PyObject *cap, *states, *types;
+	int final;
+	if (!PyArg_ParseTuple(args, "OOOp", &cap, &states, &types, &final))
+		return NULL;
+	struct lr_tabs *t = PyCapsule_GetPointer(cap, CAPSULE_NAME);
+	if (t == NULL)
+		return NULL;
+	long *ts, *st;
+	Py_ssize_t ts_n, st_n, st_cap;
+	if (lr_long_array(types, &ts, &ts_n) < 0)
+		return NULL;
+	if (lr_long_array(states, &st, &st_n) < 0) {
+		PyMem_Free(ts);
+		return NULL;
+	}
+	if (st_n == 0) {
+		PyMem_Free(ts);
+		PyMem_Free(st);
+		PyErr_SetString(PyExc_ValueError, "states must not be empty");
+		return NULL;
+	}
+	st_cap = st_n;
+
+	PyObject *result = NULL, *events = NULL;
+	long *evs = NULL;
+	Py_ssize_t evs_n = 0, evs_cap = 0, k = 0;
+	for (;;) {
+		long s = st[st_n - 1], act;
+		if (t->lr0_red[s]) {
+			act = t->dflts[s];
+		} else if (k < ts_n) {
+			act = lr_lookup_act(t, s, ts[k]);
+		} else if (final) {
+			act = lr_lookup_act(t, s, EOI);
+		} else {
+			break;
+		}
+
+		long arg = ACT_ARG(act), ev = -1;
+		if (ACT_KIND(act) == ACT_ACCEPT)
+			break;
+		if (ACT_KIND(act) == ACT_SHIFT_REDUCE) {
+			/* the shift, the last symbol never being pushed */
+			if (lr_add_event(&evs, &evs_n, &evs_cap, -1) < 0)
+				goto out;
+			++k;
+			st_n -= t->prod_len[arg] - 1;
+			arg = t->gotos[st[st_n - 1] * t->nts_n +
+							t->prod_head[arg]];
+			ev = ACT_ARG(act);
+		} else if (ACT_KIND(act) == ACT_REDUCE) {
+			st_n -= t->prod_len[arg];
+			arg = t->gotos[st[st_n - 1] * t->nts_n +
+							t->prod_head[arg]];
+			ev = ACT_ARG(act);
+		} else if (ACT_KIND(act) == ACT_SHIFT) {
+			++k;
+		} else {
+			Py_INCREF(Py_None);
+			result = Py_None;
+			goto out;
+		}
+		if (st_n == st_cap) {
+			st_cap = 2*st_cap + 64;
+			long *nst = PyMem_Realloc(st,
+					(size_t) st_cap * sizeof(long));
+			if (nst == NULL) {
+				PyErr_NoMemory();
+				goto out;
+			}
+			st = nst;
+		}
+		st[st_n++] = arg;
+		if (lr_add_event(&evs, &evs_n, &evs_cap, ev) < 0)
+			goto out;
+	}
+
+	events = PyBytes_FromStringAndSize((const char *) evs,
+				evs_n * (Py_ssize_t) sizeof(long));
+	if (events == NULL)
+		goto out;
+	PyObject *end = PyList_New(st_n);
+	if (end == NULL)
+		goto out;
+	for (Py_ssize_t i = 0; i < st_n; i++) {
+		PyObject *v = PyLong_FromLong(st[i]);
+		if (v == NULL) {
+			Py_DECREF(end);
+			goto out;
+		}
+		PyList_SET_ITEM(end, i, v);
+	}
+	result = Py_BuildValue("(OO)", events, end);
+	Py_DECREF(end);
+out:
+	Py_XDECREF(events);
+	PyMem_Free(evs);
+	PyMem_Free(ts);
+	PyMem_Free(st);
+	return result;
+}
+
+PyMethodDef lrdriver_methods[] = {
+	{"load", lrdriver_load, METH_VARARGS,
+		"load(acts, dflts, lr0_red, gotos, class_map, prod_len, "
+		"prod_head, classes_n, nts_n) -> tables"},
+	{"parse", lrdriver_parse, METH_VARARGS,
+		"parse(tables, start_state, tokens, actions) -> value"},
+	{"parse_batch", lrdriver_parse_batch, METH_VARARGS,
+		"parse_batch(tables, start_state, streams, actions, lanes) "
+		"-> results"},
+	{"trace", lrdriver_trace, METH_VARARGS,
+		"trace(tables, states, types, final) -> (events, states)"},
+	{NULL, NULL, 0, NULL},
+};
+
+struct PyModuleDef lrdriver_module = {
+	PyModuleDef_HEAD_INIT, "_lrdriver",
+	"C shift/reduce loop for lrdriver.py", -1, lrdriver_methods,
+	NULL, NULL, NULL, NULL,
+};
+
+PyMODINIT_FUNC PyInit__lrdriver(void)
+{
+	return PyModule_Create(&lrdriver_module);
+}
@@ -1,106 +1,56 @@
-from collections import namedtuple
 import sys
-from typing import Union
 
-from make_tab import SHIFT, REDUCE, ACCEPT
+from lrdriver import Tables, parse, parse_batch
 
-Token = namedtuple("Token", ["type", "val"])
-
-tk = Token(0, 0)
-tk_n = 0
-stack: list[tuple[int, Union[int, str]]] = list()
-start_state: int
-goto_tab: dict[tuple[int, Union[int, str]], int]
-state_to_sym: dict[int, Union[int, str]]
-rax: float = 0
-rbx: float = 0
+def read_tk(tk):
+    t, v = tk.split('\t', 1)
+    t = int(t)
+    v = v.rstrip()
+    try:
+        v = int(v)
+    except ValueError:
+        pass
+    return (t, v)
 
 def tk_gen():
-    global tk_n
     for tk in sys.stdin.readlines():
-        t, v = tk.split('\t', 1)
-        t = int(t)
-        v = v.rstrip()
-        try:
-            v = int(v)
-        except ValueError:
-            pass
-        tk_n += 1
-        yield (t, v)
-
-tokens = tk_gen()
-def next_token():
-    global tk
-    try:
-        tk = Token(*tokens.__next__())
-    except StopIteration:
-        tk = Token(ord('$'), "")
-
-def shift_action(tt):
-    global rax, rbx
-    if tt not in [ord('('), ord(')')]:
-        rbx = rax
-
-def reduce_action(reduction):
-    global rax, rbx
+        yield read_tk(tk)
 
-    to, frm = reduction
-    if to == "fact":
-        if frm == (ord('('), "expr", ord(')')):
-            pass
-        elif type(frm[0]) == int and len(frm) == 1:
-            rax = int(stack[-1][1])
-        else:
-            raise Exception("invalid production for fact")
-    if to == "term":
-        if frm == ("term", ord('*'), "fact"):
-            rax *= rbx
-        elif frm == ("term", ord('/'), "fact"):
-            rax = rbx / rax
-        elif frm[0] == "fact" and len(frm) == 1:
-            pass
-        else:
-            raise Exception("invalid production for term")
-    if to == "expr":
-        if frm == ("expr", ord('+'), "term"):
-            rax += rbx
-        elif frm == ("expr", ord('-'), "term"):
-            rax = rbx - rax
-        elif frm[0] == "term" and len(frm) == 1:
-            pass
-        else:
-            raise Exception("invalid production for expr")
-
-
-def parse():
-    stack.append((start_state, 0))
-
-    next_token()
-    while True:
-        s = stack[-1][0]
-        act = action_tab[s, tk.type]
-        if act[0] == SHIFT:
-            shift_action(tk.type)
-            stack.append((act[1], tk.val))
-            next_token()
-        elif act[0] == REDUCE:
-            reduce_action(act[1])
-            for _ in range(len(act[1][1])):
-                stack.pop()
-            stack.append((goto_tab[stack[-1][0], act[1][0]], "unset"))
-            #print(act[1][0], "->", [repr_sym(s) for s in act[1][1]])
-        elif act[0] == ACCEPT:
-            print(rax)
-            break
-        else:
-            print(stack)
-            print(act)
-            raise Exception("Can not handle token", tk.type)
+def read_streams():
+    # the inputs are separated by empty lines
+    streams = [[]]
+    for tk in sys.stdin.readlines():
+        if tk.strip():
+            streams[-1].append(read_tk(tk))
+        elif streams[-1]:
+            streams.append([])
+    return [s for s in streams if s]
+
+def arith_actions(prods):
+    # unit productions keep the value of their body
+    actions = {
+        ("fact", (ord('('), "expr", ord(')'))): lambda _l, e, _r: e,
+        ("term", ("term", ord('*'), "fact")): lambda a, _, b: a * b,
+        ("term", ("term", ord('/'), "fact")): lambda a, _, b: a / b,
+        ("expr", ("expr", ord('+'), "term")): lambda a, _, b: a + b,
+        ("expr", ("expr", ord('-'), "term")): lambda a, _, b: a - b,
+    }
+    for head, body in prods:
+        if head == "fact" and len(body) == 1 and type(body[0]) == int:
+            actions[head, body] = int
+    return actions
 
 
 if __name__ == "__main__":
     import pickle
     with open("lalr-tab", "rb") as f:
-        start_state, action_tab, goto_tab, state_to_sym = pickle.load(f)
-
-    parse()
+        tabs = Tables(*pickle.load(f))
+
+    # -b: evaluate every expression of a batch, one result per line
+    if len(sys.argv) > 1 and sys.argv[1] == "-b":
+        for res in parse_batch(
+            tabs, read_streams(), arith_actions(tabs.prods)
+        ):
+            print(res)
+    else:
+        print(parse(tabs, tk_gen(), arith_actions(tabs.prods)))
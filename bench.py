@@ -0,0 +1,212 @@
+"""
+Parse throughput of the runtime drivers.
+
+For every grammar, builds its tables with make_tab.py, generates
+random inputs of about --tokens tokens each and times every
+driver that can parse them, one input at a time. Reports
+tokens/sec, reductions/sec, the peak RSS of the process running
+the driver and percentiles of the latency per input.
+"""
+import contextlib
+import multiprocessing
+import os
+import random
+import resource
+import sys
+import time
+
+import arith_parser
+import expr_parser
+import lrdriver
+import parser as bn_parser
+from lrserver import build_tables
+from make_tab import TK_ID
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+
+
+def lex_bn(path):
+    # the tokens of a BN file, as lines of the lexer: every
+    # character is a token of its own, but for identifiers
+    toks = list()
+    with open(path) as f:
+        src = f.read()
+    i = 0
+    while i < len(src):
+        c = src[i]
+        if c.isspace():
+            i += 1
+        elif c.isalpha() or c == "_":
+            j = i
+            while j < len(src) and (src[j].isalnum() or src[j] == "_"):
+                j += 1
+            toks.append(f"{TK_ID}\t{src[i:j]}\n")
+            i = j
+        else:
+            toks.append(f"{ord(c)}\t{c}\n")
+            i += 1
+    return "".join(toks)
+
+def make_tables(grammar):
+    return build_tables(lex_bn(grammar), jobs=1)
+
+
+def gen_arith(rnd, size, ops="+*/"):
+    # an expression of about size tokens over TK_ID numbers; without
+    # a "-" nothing evaluates to 0, so arith_parser.py never divides by it
+    def num():
+        return (TK_ID, rnd.randint(1, 9))
+    def op():
+        o = rnd.choice(ops)
+        return (ord(o), o)
+    toks = [num()]
+    while len(toks) < size:
+        if rnd.random() < 0.2:
+            toks += [op(), (ord("("), "("), num(), op(), num(), (ord(")"), ")")]
+        else:
+            toks += [op(), num()]
+    return toks
+
+def gen_stmts(rnd, size):
+    # a block of statements of about size tokens
+    def stmt(depth):
+        r = rnd.random()
+        if depth < 4 and r < 0.1:
+            return [(ord("{"), "{")] + sum(
+                (stmt(depth + 1) for _ in range(rnd.randint(0, 3))), []
+            ) + [(ord("}"), "}")]
+        if r < 0.2:
+            return [
+                (TK_ID, "loop"), (ord("("), "("), (TK_ID, "i"),
+                (ord(";"), ";"), (ord(";"), ";"), (TK_ID, "i"),
+                (ord(")"), ")"),
+            ] + stmt(depth)
+        return [
+            (TK_ID, "x"), (ord("="), "="), (TK_ID, "y"), (ord("+"), "+"),
+            (TK_ID, "z"), (ord("*"), "*"), (TK_ID, "w"), (ord(";"), ";"),
+        ]
+    toks = [(ord("{"), "{")]
+    while len(toks) < size:
+        toks += stmt(1)
+    return toks + [(ord("}"), "}")]
+
+GRAMMARS = {
+    "arith_expr": (gen_arith, "tests/arith_expr.bn"),
+    "reduced_arith_expr":
+        (lambda rnd, size: gen_arith(rnd, size, "+*"),
+            "tests/reduced_arith_expr.bn"),
+    "sample_grammar": (gen_stmts, "tests/sample_grammar.bn"),
+}
+
+
+def count_reductions(tabs, toks):
+    run = lrdriver.trace(
+        tabs, [tabs.start_state], [t for t, _ in toks], True
+    )
+    return sum(1 for e in run[0] if e >= 0)
+
+def expr_str(toks):
+    return " ".join(str(v) if t == TK_ID else chr(t) for t, v in toks)
+
+def drivers(name, tabs):
+    # (driver, function parsing one input) pairs
+    c_tabs = tabs.c_tabs
+    py_tabs = lrdriver.Tables.__new__(lrdriver.Tables)
+    py_tabs.__dict__.update(tabs.__dict__)
+    py_tabs.c_tabs = None
+    printing = {p: bn_parser.print_reduction(*p) for p in tabs.prods}
+
+    def quiet(f):
+        def run(toks):
+            with open(os.devnull, "w") as null:
+                with contextlib.redirect_stdout(null):
+                    f(toks)
+        return run
+
+    ds = list()
+    if c_tabs is not None:
+        ds.append(("lrdriver (C)", lambda toks: lrdriver.parse(tabs, toks)))
+        ds.append(("parser.py (C)",
+            quiet(lambda toks: lrdriver.parse(tabs, toks, printing))))
+    ds.append(("lrdriver (Python)",
+        lambda toks: lrdriver.parse(py_tabs, toks)))
+    ds.append(("parser.py (Python)",
+        quiet(lambda toks: lrdriver.parse(py_tabs, toks, printing))))
+    if name != "sample_grammar":
+        acts = arith_parser.arith_actions(tabs.prods)
+        if c_tabs is not None:
+            ds.append(("arith_parser.py (C)",
+                lambda toks: lrdriver.parse(tabs, toks, acts)))
+        ds.append(("arith_parser.py (Python)",
+            lambda toks: lrdriver.parse(py_tabs, toks, acts)))
+    if name == "arith_expr":
+        ds.append(("expr_parser.py", None))
+    return ds
+
+
+def run_driver(f, inputs):
+    if f is None:
+        # the recursive descent parser takes strings
+        f, inputs = expr_parser.parse_expr, [expr_str(t) for t in inputs]
+    lat = list()
+    start = time.perf_counter()
+    for inp in inputs:
+        t = time.perf_counter()
+        f(inp)
+        lat.append(time.perf_counter() - t)
+    total = time.perf_counter() - start
+    rss = resource.getrusage(resource.RUSAGE_SELF).ru_maxrss
+    return total, sorted(lat), rss
+
+def in_child(f, *args):
+    # runs f in a forked process, so that its ru_maxrss is
+    # the peak of that driver alone (and of what it inherits)
+    ctx = multiprocessing.get_context("fork")
+    r, w = ctx.Pipe(False)
+    p = ctx.Process(target=lambda: w.send(f(*args)))
+    p.start()
+    w.close()
+    res = r.recv()
+    p.join()
+    return res
+
+def pct(lat, p):
+    return lat[min(len(lat) - 1, int(p / 100 * len(lat)))] * 1e6
+
+
+def main():
+    import argparse
+
+    argp = argparse.ArgumentParser(description=__doc__.strip())
+    argp.add_argument("-n", "--inputs", type=int, default=1000,
+        help="inputs per grammar (default: 1000)")
+    argp.add_argument("-t", "--tokens", type=int, default=100,
+        help="tokens per input (default: 100)")
+    argp.add_argument("-g", "--grammar", action="append",
+        choices=list(GRAMMARS), help="grammar to run (default: all)")
+    argp.add_argument("--seed", type=int, default=0)
+    args = argp.parse_args()
+
+    if lrdriver._lrdriver is None:
+        print("_lrdriver is not built (make pyext): "
+            "skipping the C drivers", file=sys.stderr)
+    print(f"{'grammar':<20}{'driver':<26}{'tokens/s':>12}"
+        f"{'reductions/s':>14}{'peak RSS':>11}"
+        f"{'p50 us':>9}{'p90 us':>9}{'p99 us':>9}")
+    for name in args.grammar or GRAMMARS:
+        gen, path = GRAMMARS[name]
+        tabs = make_tables(os.path.join(HERE, path))
+        rnd = random.Random(args.seed)
+        inputs = [gen(rnd, args.tokens) for _ in range(args.inputs)]
+        tokens = sum(len(toks) for toks in inputs)
+        reds = sum(count_reductions(tabs, toks) for toks in inputs)
+        for driver, f in drivers(name, tabs):
+            total, lat, rss = in_child(run_driver, f, inputs)
+            red_rate = "-" if f is None else f"{reds / total:.0f}"
+            print(f"{name:<20}{driver:<26}{tokens / total:12.0f}"
+                f"{red_rate:>14}{rss // 1024:>8} MB"
+                f"{pct(lat, 50):9.1f}{pct(lat, 90):9.1f}{pct(lat, 99):9.1f}")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,279 @@
+#include "gen.h"
+#include "grammar.h"
+#include "lexer.h"
+#include "utils.h"
+
+#include <assert.h>
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* The length of a derivation that does not exist or has no bound. */
+#define LEN_INF		((size_t) -1)
+
+/* min_len[j] and max_len[j] are the lengths of the shortest and
+ * longest sentences derived from the j-th nonterminal, and the
+ * shortest one starts with the min_prod[j]-th production. These
+ * productions form no cycle, so following them always ends.
+ * prod_min[p] and prod_max[p] are the same for the body of the
+ * p-th production.
+ */
+size_t *min_len, *max_len, *min_prod, *prod_min, *prod_max;
+unsigned int *prod_weight;
+
+size_t gen_min_depth, gen_max_depth = LEN_INF;
+uint64_t gen_state = 1;
+
+/* A symbol left to expand into about budget tokens. */
+struct gen_frame {
+	size_t sym;
+	size_t budget;
+	size_t depth;
+} *gen_stack;
+size_t gen_stack_cap;
+
+size_t add_lens(size_t a, size_t b)
+{
+	return a == LEN_INF || b == LEN_INF ? LEN_INF : a + b;
+}
+
+/* Returns the length of the body of p, its nonterminals counting len[]. */
+size_t body_len(const size_t *len, size_t p)
+{
+	size_t l = 0;
+	for (size_t k = prod_off[p]; k < prod_off[p+1]; k++)
+		l = add_lens(l, prod_syms[k] < TK_TYPE_COUNT ? 1
+				: len[prod_syms[k] - TK_TYPE_COUNT]);
+	return l;
+}
+
+/*
+ * Knuth's generalization of Dijkstra's algorithm: the nonterminal
+ * with the shortest body made of terminals and of nonterminals
+ * already done is done next, with that length.
+ */
+void compute_min_lens()
+{
+	for (size_t j = 0; j < nts_n; j++)
+		min_len[j] = LEN_INF;
+	for (;;) {
+		size_t best = LEN_INF, best_p = prods_n;
+		for (size_t p = 0; p < prods_n; p++) {
+			if (min_len[prod_head[p]] != LEN_INF)
+				continue;
+			size_t l = body_len(min_len, p);
+			if (l < best) {
+				best = l;
+				best_p = p;
+			}
+		}
+		if (best_p == prods_n)
+			break;
+		min_len[prod_head[best_p]] = best;
+		min_prod[prod_head[best_p]] = best_p;
+	}
+	for (size_t p = 0; p < prods_n; p++)
+		prod_min[p] = body_len(min_len, p);
+}
+
+/*
+ * Longest sentences by relaxation over the productions that derive
+ * some sentence. Without a cycle that lengthens them, they are
+ * settled after nts_n rounds, so what still grows has no bound.
+ */
+void compute_max_lens()
+{
+	for (size_t j = 0; j < nts_n; j++)
+		max_len[j] = 0;
+	int changed = 1;
+	for (size_t r = 0; changed; r++) {
+		changed = 0;
+		for (size_t p = 0; p < prods_n; p++) {
+			if (prod_min[p] == LEN_INF)
+				continue;
+			size_t l = body_len(max_len, p);
+			size_t *m = &max_len[prod_head[p]];
+			if (*m != LEN_INF && l > *m) {
+				*m = r < nts_n ? l : LEN_INF;
+				changed = 1;
+			}
+		}
+	}
+	for (size_t p = 0; p < prods_n; p++)
+		prod_max[p] = prod_min[p] == LEN_INF ? 0 : body_len(max_len, p);
+}
+
+/* Returns the index of the nonterminal name, nts_n if there is none. */
+size_t nt_num(const char *name)
+{
+	size_t j = 0;
+	struct sym_list *nts = nts_in_grammar;
+	for (; nts != NULL; nts = nts->next, j++)
+		if (strcmp(nts->sym->nt_name, name) == 0)
+			break;
+	return j;
+}
+
+void init_gen()
+{
+	min_len = realloc(min_len, nts_n * sizeof(size_t));
+	max_len = realloc(max_len, nts_n * sizeof(size_t));
+	min_prod = realloc(min_prod, nts_n * sizeof(size_t));
+	prod_min = realloc(prod_min, prods_n * sizeof(size_t));
+	prod_max = realloc(prod_max, prods_n * sizeof(size_t));
+	prod_weight = realloc(prod_weight, prods_n * sizeof(unsigned int));
+	for (size_t p = 0; p < prods_n; p++)
+		prod_weight[p] = 1;
+	compute_min_lens();
+	compute_max_lens();
+	if (min_len[nt_num(start_sym)] == LEN_INF)
+		panic("%s derives no sentence", start_sym);
+}
+
+void seed_gen(uint64_t seed)
+{
+	/* xorshift must not start from 0 */
+	gen_state = seed << 1 | 1;
+}
+
+/* xorshift64* */
+uint64_t gen_rand()
+{
+	gen_state ^= gen_state >> 12;
+	gen_state ^= gen_state << 25;
+	gen_state ^= gen_state >> 27;
+	return gen_state * 0x2545f4914f6cdd1dull;
+}
+
+void set_prod_weight(const char *head, size_t k, unsigned int w)
+{
+	size_t j = nt_num(head);
+	if (j == nts_n)
+		panic("no nonterminal %s", head);
+	if (k == 0 || k > nt_prods[j+1] - nt_prods[j])
+		panic("%s has no production %zu", head, k);
+	/* fill_prod_tab() numbers them from the last one */
+	prod_weight[nt_prods[j+1] - k] = w;
+}
+
+int has_nt(size_t p)
+{
+	for (size_t k = prod_off[p]; k < prod_off[p+1]; k++)
+		if (prod_syms[k] >= TK_TYPE_COUNT)
+			return 1;
+	return 0;
+}
+
+/*
+ * Ranks p for a budget of b tokens at depth d: 0 if it does
+ * not fit, higher if it can fill the budget and higher still
+ * if it goes deeper while under gen_min_depth.
+ */
+unsigned int prod_rank(size_t p, size_t b, size_t d)
+{
+	if (prod_weight[p] == 0 || prod_min[p] > b)
+		return 0;
+	unsigned int r = 1;
+	if (prod_max[p] >= b)
+		r += 1;
+	if (d >= gen_min_depth || has_nt(p))
+		r += 2;
+	return r;
+}
+
+/* Picks by weight among the best ranked productions of j. */
+size_t choose_prod(size_t j, size_t b, size_t d)
+{
+	if (d >= gen_max_depth)
+		return min_prod[j];
+	unsigned int best = 0;
+	uint64_t total = 0;
+	for (size_t p = nt_prods[j]; p < nt_prods[j+1]; p++) {
+		unsigned int r = prod_rank(p, b, d);
+		if (r > best) {
+			best = r;
+			total = 0;
+		}
+		if (r == best)
+			total += prod_weight[p];
+	}
+	if (best == 0)
+		return min_prod[j];
+	uint64_t x = gen_rand() % total;
+	for (size_t p = nt_prods[j]; p < nt_prods[j+1]; p++) {
+		if (prod_rank(p, b, d) != best)
+			continue;
+		if (x < prod_weight[p])
+			return p;
+		x -= prod_weight[p];
+	}
+	assert(0);
+	return min_prod[j];
+}
+
+/*
+ * Tokens named by a character are their own value, other
+ * tokens (names, literals) get a number from 1 to 9.
+ */
+size_t print_gen_token(size_t tt, FILE *out)
+{
+	int n;
+	if (tt < 128 && isgraph((int) tt))
+		n = fprintf(out, "%zu\t%c\n", tt, (int) tt);
+	else
+		n = fprintf(out, "%zu\t%u\n", tt, (unsigned int) (1 + gen_rand() % 9));
+	assert(n > 0);
+	return (size_t) n;
+}
+
+/*
+ * Expands the leftmost symbol first, splitting what the budget
+ * of a production leaves over its shortest body at random among
+ * the nonterminals of the body, as far as each of them can take.
+ */
+size_t gen_sentence(size_t len, FILE *out)
+{
+	size_t n = 0, bytes = 0;
+	if (gen_stack_cap == 0) {
+		gen_stack_cap = 64;
+		gen_stack = malloc(gen_stack_cap * sizeof(struct gen_frame));
+	}
+	gen_stack[n++] = (struct gen_frame) {
+		TK_TYPE_COUNT + nt_num(start_sym), len, 0
+	};
+	while (n > 0) {
+		struct gen_frame f = gen_stack[--n];
+		if (f.sym < TK_TYPE_COUNT) {
+			bytes += print_gen_token(f.sym, out);
+			continue;
+		}
+		size_t p = choose_prod(f.sym - TK_TYPE_COUNT, f.budget, f.depth);
+		size_t extra = f.budget > prod_min[p] ? f.budget - prod_min[p] : 0;
+		size_t body_n = prod_off[p+1] - prod_off[p], nts_left = 0;
+		for (size_t k = prod_off[p]; k < prod_off[p+1]; k++)
+			if (prod_syms[k] >= TK_TYPE_COUNT)
+				++nts_left;
+		while (n + body_n > gen_stack_cap) {
+			gen_stack_cap *= 2;
+			gen_stack = realloc(gen_stack,
+				gen_stack_cap * sizeof(struct gen_frame));
+		}
+		/* pushed from the right, so that the left is expanded first */
+		for (size_t k = prod_off[p+1]; k-- > prod_off[p];) {
+			size_t s = prod_syms[k], b = 1;
+			if (s >= TK_TYPE_COUNT) {
+				size_t j = s - TK_TYPE_COUNT, share = extra;
+				if (--nts_left > 0)
+					share = gen_rand() %
+						(2 * extra / (nts_left + 1) + 1);
+				if (max_len[j] != LEN_INF &&
+					share > max_len[j] - min_len[j])
+					share = max_len[j] - min_len[j];
+				extra -= share;
+				b = min_len[j] + share;
+			}
+			gen_stack[n++] = (struct gen_frame) {s, b, f.depth + 1};
+		}
+	}
+	return bytes;
+}
@@ -0,0 +1,90 @@
+#include "gen.h"
+#include "grammar.h"
+#include "lexer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void usage()
+{
+	fprintf(stderr, "usage: gen.out [-n TOKENS] [-c SENTENCES | -s SIZE]"
+		" [-d MAXDEPTH] [-D MINDEPTH]\n"
+		"\t[-w HEAD:K=WEIGHT]... [-r SEED] [GRAMMAR.bn]\n");
+	exit(1);
+}
+
+/* Parses a size with an optional K, M or G suffix. */
+size_t parse_size(const char *s)
+{
+	char *end;
+	size_t n = strtoull(s, &end, 10);
+	switch (*end) {
+	case 'G':	n <<= 10;	/* fall through */
+	case 'M':	n <<= 10;	/* fall through */
+	case 'K':	n <<= 10;	++end;
+	}
+	if (end == s || *end != '\0')
+		usage();
+	return n;
+}
+
+/*
+ * Writes random sentences of the grammar (stdin if none is
+ * given) in the format parser.py reads, separated by empty
+ * lines as arith_parser.py -b reads them. -n is the length
+ * aimed at, -c the number of sentences and -s the size to
+ * write instead, -w HEAD:K=WEIGHT weighs the K-th production
+ * of HEAD (1 by default, 0 to leave it out where possible).
+ */
+int main(int argc, char **argv)
+{
+	size_t len = 100, count = 1, size = 0;
+	const char *weights[64];
+	size_t weights_n = 0;
+
+	int i = 1;
+	for (; i < argc && argv[i][0] == '-'; i += 2) {
+		if (i + 1 == argc || argv[i][1] == '\0' || argv[i][2] != '\0')
+			usage();
+		const char *arg = argv[i+1];
+		switch (argv[i][1]) {
+		case 'n':	len = parse_size(arg);		break;
+		case 'c':	count = parse_size(arg);	break;
+		case 's':	size = parse_size(arg);		break;
+		case 'd':	gen_max_depth = parse_size(arg);	break;
+		case 'D':	gen_min_depth = parse_size(arg);	break;
+		case 'r':	seed_gen(parse_size(arg));	break;
+		case 'w':
+			if (weights_n == sizeof(weights) / sizeof(*weights))
+				usage();
+			weights[weights_n++] = arg;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (i + 1 < argc)
+		usage();
+
+	init_lexer(i < argc ? argv[i] : NULL);
+	read_bn();
+	init_gen();
+	for (size_t k = 0; k < weights_n; k++) {
+		char head[256];
+		size_t n;
+		unsigned int w;
+		if (sscanf(weights[k], "%255[^:]:%zu=%u", head, &n, &w) != 3)
+			usage();
+		set_prod_weight(head, n, w);
+	}
+
+	setvbuf(stdout, malloc(1 << 16), _IOFBF, 1 << 16);
+	size_t written = 0;
+	for (size_t k = 0; size ? written < size : k < count; k++) {
+		if (k > 0)
+			written += (size_t) printf("\n");
+		written += gen_sentence(len, stdout);
+	}
+	return 0;
+}
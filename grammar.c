@@ -3,6 +3,7 @@
 #include "utils.h"
 
 #include <assert.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -14,7 +15,7 @@ const char *start_sym;
 struct symbol *curr_sym, es_sym = {1,EMPTY_STR,NULL}, eoi_sym = {1,EOI,NULL};
 struct symbol *make_symbol(int is_term, enum tk_type term_type,
 						const char *nt_name) {
-	struct symbol *s = malloc(sizeof(struct symbol));
+	struct symbol *s = mem_alloc(sizeof(struct symbol), MEM_SYMBOL);
 	s->is_term = is_term;
 	s->term_type = term_type;
 	s->nt_name = nt_name;
@@ -22,7 +23,7 @@ struct symbol *make_symbol(int is_term, enum tk_type term_type,
 }
 
 struct sym_list *add_sym_to_list(struct symbol *sym, struct sym_list **slp) {
-	struct sym_list *slnk = malloc(sizeof(struct sym_list));
+	struct sym_list *slnk = mem_alloc(sizeof(struct sym_list), MEM_SYM_LIST);
 	slnk->sym = sym;
 	ADD_LINK(slnk, *slp);
 	return slnk;
@@ -43,7 +44,7 @@ struct item {
 
 struct item *make_item(const char *head, struct sym_list *body,
 						struct sym_list *dot) {
-	struct item *it = malloc(sizeof(struct item));
+	struct item *it = mem_alloc(sizeof(struct item), MEM_ITEM);
 	it->head = head;
 	it->body = body;
 	it->dot = dot;
@@ -51,7 +52,6 @@ struct item *make_item(const char *head, struct sym_list *body,
 }
 
 struct goto_nt_rule_entry {
-	struct goto_nt_rule_entry *next;
 	const char *key;
 	struct itm_list *canon_itm;
 };
@@ -59,13 +59,13 @@ struct goto_nt_rule_entry {
 struct itm_list {
 	struct itm_list *next;
 	struct item *itm;
-	struct goto_nt_rule_entry *gt_nt_rs[HASHSIZE];
+	HMAP(goto_nt_rule_map, struct goto_nt_rule_entry) gt_nt_rs;
 	struct itm_list *gt_term_rs[TK_TYPE_COUNT];
 } **canon_coll;
 size_t canon_coll_n;
 
 struct itm_list *add_itm_to_list(struct item *itm, struct itm_list **il) {
-	struct itm_list *ilnk = malloc(sizeof(struct itm_list));
+	struct itm_list *ilnk = mem_calloc(1, sizeof(struct itm_list), MEM_ITM_LIST);
 	ilnk->itm = itm;
 	ADD_LINK(ilnk, *il);
 	return ilnk;
@@ -76,14 +76,49 @@ struct itm_list_list {
 	struct itm_list *il;
 } *canon_set;
 
-struct prod_head_entry *productions[HASHSIZE];
+union prod_head_map productions;
 int term_in_grammar[TK_TYPE_COUNT];
 
+/* XXX: BN_DECL introduces a precedence declaration
+ * and, like EOI, its token type is given by its
+ * character representation.
+ */
+#define BN_DECL		((enum tk_type) '%')
+
+enum assoc {
+	ASSOC_NONE,	ASSOC_LEFT,
+	ASSOC_RIGHT,	ASSOC_NONASSOC,
+};
+/* term_prec[tt] is 0 if tt has no declared precedence */
+int term_prec[TK_TYPE_COUNT];
+enum assoc term_assoc[TK_TYPE_COUNT];
+
 struct sym_list_entry {
-	struct sym_list_entry *next;
 	const char *key;
 	struct sym_list *sl;
-} *first_of_nt[HASHSIZE], *follow_tab[HASHSIZE];
+};
+HMAP(sym_list_map, struct sym_list_entry) first_of_nt, follow_tab;
+
+#define TERM_WORDS	BITSET_WORDS(TK_TYPE_COUNT)
+
+/* first_sets[j] is FIRST(B) - {EMPTY_STR} as a bitset of
+ * terminal types, B being the j-th nonterminal, and the
+ * j-th bit of nullable_nts is set if B is nullable.
+ * The nonterminals of a strongly connected component of
+ * the "B may begin with C" graph share their first_set.
+ */
+unsigned long **first_sets, *nullable_nts;
+
+/* follow_sets[j] is FOLLOW(B) as a bitset of terminal
+ * types (EOI included), B being the j-th nonterminal.
+ */
+unsigned long **follow_sets;
+
+/* suffix_first[x] is FIRST(y) - {EMPTY_STR} and the x-th bit
+ * of nullable_suffixes is set if y is nullable, y being what
+ * follows the dot of the item numbered x by ITEM_POS().
+ */
+unsigned long **suffix_first, *nullable_suffixes;
 
 enum act_type {
 	ACT_ACC = 1,	ACT_ERR,
@@ -96,6 +131,56 @@ struct action_entry {
 	struct sym_list *reduce_from;
 } ***action_tab;
 
+/* goto_tab[i][j] is the state reached from state i on the
+ * j-th nonterminal of nts_in_grammar (canon_coll_n if none).
+ */
+size_t **goto_tab;
+size_t nts_n;
+
+#define NO_STATE	((size_t) -1)
+
+enum tab_kind tab_kind = TAB_SLR;
+
+struct nt_index_entry {
+	const char *key;
+	size_t idx;
+};
+HMAP(nt_index_map, struct nt_index_entry) nt_index;
+
+/* The productions are numbered by fill_prod_tab(), grouped
+ * by nonterminal in nts_in_grammar order: the productions of
+ * the j-th nonterminal are those from nt_prods[j] to
+ * nt_prods[j+1]. The body of the p-th production is kept as
+ * the sym_index() of its symbols, from prod_syms[prod_off[p]]
+ * to prod_syms[prod_off[p+1]] (`` is left out, so A -> ``
+ * has an empty body), and its head is the prod_head[p]-th
+ * nonterminal.
+ */
+uint32_t *prod_syms;
+size_t prods_n, *nt_prods, *prod_off, *prod_head;
+#define PROD_LEN(P)	(prod_off[(P)+1] - prod_off[P])
+
+/* The LR(0) item of the p-th production with the dot after
+ * its d first symbols is packed as ITEM(p, d), so that items
+ * order as integers by production and then by dot, and sets
+ * of items are kept as sorted arrays of them. ITEM_POS(p, d)
+ * numbers the items of all the productions (a production has
+ * one more item than symbols) and lr0_itms[ITEM_POS(p, d)] is
+ * the item as a struct item.
+ */
+#define DOT_BITS	10
+#define ITEM(P, D)	((uint32_t) ((P) << DOT_BITS | (D)))
+#define ITEM_PROD(I)	((size_t) ((I) >> DOT_BITS))
+#define ITEM_DOT(I)	((size_t) ((I) & ((1u << DOT_BITS) - 1)))
+#define ITEM_POS(P, D)	(prod_off[P] + (P) + (D))
+struct item **lr0_itms;
+size_t lr0_itms_n;
+
+/* clos_tab[j] is the bitset of productions whose items
+ * CLOSURE({ [ A -> x.By ] }) adds when B is the j-th nonterminal.
+ */
+unsigned long **clos_tab;
+
 void init_grammar()
 {
 	curr_head = start_sym = NULL;
@@ -105,12 +190,13 @@ void init_grammar()
 	for (size_t i = 0; i < TK_TYPE_COUNT; i++) {
 		first_of_term[i] = NULL;
 		term_in_grammar[i] = 0;
+		term_prec[i] = 0;
+		term_assoc[i] = ASSOC_NONE;
 	}
-	for (size_t i = 0; i < HASHSIZE; i++) {
-		productions[i] = NULL;
-		first_of_nt[i] = NULL;
-		follow_tab[i] = NULL;
-	}
+	hmap_clear(&productions.m);
+	hmap_clear(&first_of_nt.m);
+	hmap_clear(&follow_tab.m);
+	hmap_clear(&nt_index.m);
 }
 
 int sym_in_sym_list(struct symbol *sym, struct sym_list *sl)
@@ -137,29 +223,6 @@ int sym_in_sym_list(struct symbol *sym, struct sym_list *sl)
 	return 0;
 }
 
-/*
- * Compares items in il with itm. If any of them
- * matches, returns 1, otherwise returns 0.
- * XXX: items are compared by checking if the
- * body pointers and dot pointers are equal.
- * It does not check for "deep copies".
- */
-int itm_in_itm_list(struct item *itm, struct itm_list *il)
-{
-	assert(itm != NULL);
-	for (; il != NULL; il = il->next) {
-		assert(il->itm != NULL);
-		if (il->itm->body != itm->body)
-			continue;
-		if (il->itm->dot != itm->dot)
-			continue;
-		if (strcmp(il->itm->head, itm->head) != 0)
-			continue;
-		return 1;
-	}
-	return 0;
-}
-
 #define MAX_TERMLEN	8
 char *repr_sym(struct symbol *sym)
 {
@@ -177,17 +240,16 @@ char *repr_sym(struct symbol *sym)
 		return repr;
 	}
 
-	repr = malloc(MAX_TERMLEN);
-	assert(repr != NULL);
+	char buf[MAX_TERMLEN];
 	switch (sym->term_type) {
 		/* TODO: handle missing cases */
 		case TK_ID:
-			snprintf(repr, MAX_TERMLEN, "`TK_ID`");
+			snprintf(buf, MAX_TERMLEN, "`TK_ID`");
 			break;
 		default:
-			snprintf(repr, MAX_TERMLEN, "`%c`", sym->term_type);
+			snprintf(buf, MAX_TERMLEN, "`%c`", sym->term_type);
 	}
-	return repr;
+	return strdup(buf);
 }
 
 void print_sym_list(struct sym_list *sl)
@@ -197,7 +259,7 @@ void print_sym_list(struct sym_list *sl)
 		assert(sp->sym != NULL);
 		sym_repr = repr_sym(sp->sym);
 		printf(sp->sym->is_term ? "%s " : "<%s> ", sym_repr);
-		free(sym_repr);
+		mem_free(sym_repr, strlen(sym_repr) + 1, MEM_STR);
 	}
 }
 
@@ -211,14 +273,15 @@ void print_item(struct item *itm) {
 	for (; bp != dp; bp = bp->next) {
 		sym_repr = repr_sym(bp->sym);
 		printf("%s ", sym_repr);
+		mem_free(sym_repr, strlen(sym_repr) + 1, MEM_STR);
 	}
 	putchar('.');
 	for (; dp != NULL; dp = dp->next) {
 		sym_repr = repr_sym(dp->sym);
 		printf("%s ", sym_repr);
+		mem_free(sym_repr, strlen(sym_repr) + 1, MEM_STR);
 	}
 	putchar(']');
-	free(sym_repr);
 }
 
 void print_prods(struct prod_list *prods)
@@ -237,16 +300,14 @@ void print_prods(struct prod_list *prods)
 
 void print_grammar()
 {
-	for (size_t i = 0; i < HASHSIZE; i++) {
-		if (productions[i] == NULL)
+	for (size_t i = 0; i < productions.m.cap; i++) {
+		struct prod_head_entry *ep = productions.m.slots[i].val;
+		if (ep == NULL)
 			continue;
-		struct prod_head_entry *ep = productions[i];
-		for (; ep != NULL; ep = ep->next) {
-			assert(ep->prods != NULL);
-			printf("<%s> ::= ", ep->key);
-			print_prods(ep->prods);
-			putchar('\n');
-		}
+		assert(ep->prods != NULL);
+		printf("<%s> ::= ", ep->key);
+		print_prods(ep->prods);
+		putchar('\n');
 	}
 }
 
@@ -374,7 +435,7 @@ void add_prod()
 	assert(curr_prod != NULL);
 	curr_prod = reverse_linked_list(curr_prod);
 
-	struct prod_list *new_prod = malloc(sizeof(struct prod_list));
+	struct prod_list *new_prod = mem_alloc(sizeof(struct prod_list), MEM_PROD);
 	assert(new_prod != NULL);
 	new_prod->prod = curr_prod;
 	struct prod_head_entry *cnt;
@@ -431,7 +492,7 @@ void parse_prods()
 			struct prod_head_entry *ne;
 			LOOK_UP(ne, curr_head, productions);
 			if (ne == NULL) {
-				ne = malloc(sizeof(struct prod_head_entry));
+				ne = mem_alloc(sizeof(struct prod_head_entry), MEM_ENTRY);
 				INSERT_ENTRY(ne, curr_head, productions);
 				ne->prods = NULL;
 			}
@@ -467,6 +528,45 @@ void parse_prods()
 	}
 }
 
+/*
+ * Parses the precedence declarations that
+ * can precede the first definition:
+ * %left `+` `-`
+ * %left `*` `/`
+ * %right `^`
+ * Every declaration binds its terminals
+ * tighter than the ones declared before it.
+ */
+void parse_prec_decls()
+{
+	int level = 0;
+	while (tk.type == BN_DECL) {
+		next_token(&tk);
+		if (tk.type != TK_ID)
+			panic("expected left, right or nonassoc");
+		enum assoc as = ASSOC_NONASSOC;
+		if (strcmp(tk.str_val, "left") == 0)
+			as = ASSOC_LEFT;
+		else if (strcmp(tk.str_val, "right") == 0)
+			as = ASSOC_RIGHT;
+		else if (strcmp(tk.str_val, "nonassoc") == 0)
+			as = ASSOC_NONASSOC;
+		else
+			panic("unknown declaration %%%s", tk.str_val);
+		++level;
+		next_token(&tk);
+		if (tk.type != TK_BACTK)
+			panic("expected '`'");
+		while (tk.type == TK_BACTK) {
+			next_token(&tk);
+			term_prec[tk.type] = level;
+			term_assoc[tk.type] = as;
+			next_token(&tk);
+			skip_tks("`");
+		}
+	}
+}
+
 void augment_grammar()
 {
 	assert(start_sym != NULL);
@@ -475,7 +575,7 @@ void augment_grammar()
 	curr_prod = NULL;
 	curr_head = extended_str(start_sym, "_s");
 	// TODO assert that start_sym + "_s" is not an existing symbol in nts_in_grammar
-	struct prod_head_entry *ne = malloc(sizeof(struct prod_head_entry));
+	struct prod_head_entry *ne = mem_alloc(sizeof(struct prod_head_entry), MEM_ENTRY);
 	INSERT_ENTRY(ne, curr_head, productions);
 	ne->prods = NULL;
 
@@ -487,6 +587,264 @@ void augment_grammar()
 	start_sym = curr_head;
 }
 
+struct prod_head_entry *prods_of(const char *head)
+{
+	struct prod_head_entry *phe;
+	LOOK_UP(phe, head, productions);
+	assert(phe != NULL);
+	return phe;
+}
+
+int is_nt_named(struct symbol *sym, const char *name)
+{
+	return !sym->is_term && strcmp(sym->nt_name, name) == 0;
+}
+
+int same_sym(struct symbol *a, struct symbol *b)
+{
+	if (a->is_term || b->is_term)
+		return a->is_term && b->is_term && a->term_type == b->term_type;
+	return strcmp(a->nt_name, b->nt_name) == 0;
+}
+
+/*
+ * Returns a copy of the symbols of a followed by those of b,
+ * `` left out but for the body of an empty production.
+ */
+struct sym_list *concat_syms(struct sym_list *a, struct sym_list *b)
+{
+	struct sym_list *sl = NULL;
+	for (; a != NULL; a = a->next)
+		if (!a->sym->is_term || a->sym->term_type != EMPTY_STR)
+			add_sym_to_list(a->sym, &sl);
+	for (; b != NULL; b = b->next)
+		if (!b->sym->is_term || b->sym->term_type != EMPTY_STR)
+			add_sym_to_list(b->sym, &sl);
+	if (sl == NULL) {
+		add_sym_to_list(make_symbol(1, EMPTY_STR, NULL), &sl);
+		term_in_grammar[EMPTY_STR] = 1;
+	}
+	return reverse_linked_list(sl);
+}
+
+void add_prod_to_list(struct sym_list *body, struct prod_list **pl)
+{
+	struct prod_list *new_prod = mem_alloc(sizeof(struct prod_list),
+								MEM_PROD);
+	new_prod->prod = body;
+	ADD_LINK(new_prod, *pl);
+}
+
+/* Adds a nonterminal with no productions, named base_1 (or base_1_1...). */
+struct prod_head_entry *add_derived_nt(const char *base)
+{
+	char *name = extended_str(base, "_1");
+	struct prod_head_entry *ne;
+	for (;;) {
+		LOOK_UP(ne, name, productions);
+		if (ne == NULL)
+			break;
+		char *longer = extended_str(name, "_1");
+		mem_free(name, strlen(name) + 1, MEM_STR);
+		name = longer;
+	}
+	ne = mem_alloc(sizeof(struct prod_head_entry), MEM_ENTRY);
+	INSERT_ENTRY(ne, name, productions);
+	ne->prods = NULL;
+	mem_free(name, strlen(name) + 1, MEM_STR);
+	return ne;
+}
+
+/*
+ * Returns the defined nonterminals in the order they are
+ * reached from the start symbol, the unreachable ones last,
+ * and sets *n to their number. The array holds *n + 1 names.
+ */
+const char **nts_in_order(size_t *n)
+{
+	struct hmap *m = &productions.m;
+	const char **order = mem_alloc((m->n + 1) * sizeof(char *),
+								MEM_SCRATCH);
+	/* nonterminals are numbered by their slot in productions */
+	unsigned long *seen = make_bitset(m->cap);
+	size_t k = 0, slot = 0, s = hmap_find(m, start_sym);
+	assert(s < m->cap);
+	BIT_SET(seen, s);
+	order[k++] = m->slots[s].key;
+	for (size_t i = 0; i < k; i++) {
+		struct prod_list *pl = prods_of(order[i])->prods;
+		for (; pl != NULL; pl = pl->next) {
+			for (struct sym_list *sl = pl->prod; sl != NULL;
+							sl = sl->next) {
+				if (sl->sym->is_term)
+					continue;
+				s = hmap_find(m, sl->sym->nt_name);
+				if (s == m->cap || BIT_TEST(seen, s))
+					continue;
+				BIT_SET(seen, s);
+				order[k++] = m->slots[s].key;
+			}
+		}
+		for (; i + 1 == k && slot < m->cap; slot++) {
+			if (m->slots[slot].key == NULL || BIT_TEST(seen, slot))
+				continue;
+			BIT_SET(seen, slot);
+			order[k++] = m->slots[slot].key;
+		}
+	}
+	free_bitset(seen, m->cap);
+	*n = k;
+	return order;
+}
+
+/*
+ * ll_conflicts counts the entries of ll_tab claimed by more
+ * than one production and the nonterminals that derive
+ * themselves, which no LL(1) grammar has.
+ */
+size_t ll_conflicts;
+
+/*
+ * Removes left recursion (py_grammar.elim_left_rec()): with
+ * the nonterminals in nts_in_order() order, A_i -> A_j y for
+ * j < i is replaced by A_i -> x y for every A_j -> x, and then
+ * A -> A x | y by A -> y A_1 and A_1 -> x A_1 | ``. A cycle,
+ * A -> A, is dropped and counted in ll_conflicts. Like the
+ * textbook algorithm, misses left recursion hidden behind a
+ * nullable prefix.
+ */
+void elim_left_rec()
+{
+	size_t n;
+	const char **order = nts_in_order(&n);
+	for (size_t i = 0; i < n; i++) {
+		struct prod_head_entry *ai = prods_of(order[i]);
+		struct prod_list *pl, *next;
+		for (size_t j = 0; j < i; j++) {
+			struct prod_head_entry *aj = prods_of(order[j]);
+			struct prod_list *kept = NULL;
+			for (pl = ai->prods; pl != NULL; pl = next) {
+				next = pl->next;
+				if (!is_nt_named(pl->prod->sym, aj->key)) {
+					ADD_LINK(pl, kept);
+					continue;
+				}
+				struct prod_list *jl = aj->prods;
+				for (; jl != NULL; jl = jl->next)
+					add_prod_to_list(concat_syms(jl->prod,
+						pl->prod->next), &kept);
+			}
+			ai->prods = reverse_linked_list(kept);
+		}
+
+		struct prod_list *rec = NULL, *rest = NULL;
+		for (pl = ai->prods; pl != NULL; pl = next) {
+			next = pl->next;
+			if (!is_nt_named(pl->prod->sym, ai->key)) {
+				ADD_LINK(pl, rest);
+			} else if (pl->prod->next != NULL) {
+				ADD_LINK(pl, rec);
+			} else {
+				++ll_conflicts;
+				fprintf(stderr, "LL(1) conflict: %s derives "
+							"itself\n", ai->key);
+			}
+		}
+		ai->prods = reverse_linked_list(rest);
+		if (rec == NULL)
+			continue;
+		struct prod_head_entry *a1 = add_derived_nt(ai->key);
+		struct sym_list *tail = NULL;
+		add_sym_to_list(make_symbol(0, 0, a1->key), &tail);
+		rest = NULL;
+		for (pl = ai->prods; pl != NULL; pl = pl->next)
+			add_prod_to_list(concat_syms(pl->prod, tail), &rest);
+		ai->prods = reverse_linked_list(rest);
+		add_prod_to_list(concat_syms(NULL, NULL), &a1->prods);
+		for (pl = rec; pl != NULL; pl = pl->next)
+			add_prod_to_list(concat_syms(pl->prod->next, tail),
+								&a1->prods);
+	}
+	mem_free(order, (n + 1) * sizeof(char *), MEM_SCRATCH);
+}
+
+/* Returns the length of the common prefix of a and b. */
+size_t common_prefix(struct sym_list *a, struct sym_list *b)
+{
+	size_t n = 0;
+	for (; a != NULL && b != NULL && same_sym(a->sym, b->sym);
+						a = a->next, b = b->next)
+		++n;
+	return n;
+}
+
+/*
+ * Left factors every nonterminal: while two of its productions
+ * begin with the same symbol, those that do, A -> x y1 | x y2
+ * ... with x their longest common prefix, are replaced by
+ * A -> x A_1, and A_1 -> y1 | y2 ... is factored in turn.
+ */
+void left_factor()
+{
+	size_t n;
+	const char **order = nts_in_order(&n);
+	size_t cap = n + 1;
+	for (size_t i = 0; i < n; i++) {
+		struct prod_head_entry *a = prods_of(order[i]);
+		for (;;) {
+			struct prod_list *pl = a->prods, *ql = NULL;
+			for (; pl != NULL; pl = pl->next) {
+				if (pl->prod->sym->is_term &&
+					pl->prod->sym->term_type == EMPTY_STR)
+					continue;
+				for (ql = pl->next; ql != NULL; ql = ql->next)
+					if (same_sym(pl->prod->sym, ql->prod->sym))
+						break;
+				if (ql != NULL)
+					break;
+			}
+			if (pl == NULL)
+				break;
+			size_t len = common_prefix(pl->prod, ql->prod);
+			for (ql = ql->next; ql != NULL; ql = ql->next)
+				if (same_sym(pl->prod->sym, ql->prod->sym) &&
+					common_prefix(pl->prod, ql->prod) < len)
+					len = common_prefix(pl->prod, ql->prod);
+
+			struct prod_head_entry *a1 = add_derived_nt(a->key);
+			struct sym_list *prefix = NULL, *sl = pl->prod;
+			for (size_t k = 0; k < len; k++, sl = sl->next)
+				add_sym_to_list(sl->sym, &prefix);
+			add_sym_to_list(make_symbol(0, 0, a1->key), &prefix);
+			prefix = reverse_linked_list(prefix);
+
+			struct prod_list *kept = NULL, *next;
+			struct symbol *first = pl->prod->sym;
+			for (ql = a->prods; ql != NULL; ql = next) {
+				next = ql->next;
+				if (!same_sym(first, ql->prod->sym)) {
+					ADD_LINK(ql, kept);
+					continue;
+				}
+				sl = ql->prod;
+				for (size_t k = 0; k < len; k++)
+					sl = sl->next;
+				add_prod_to_list(concat_syms(sl, NULL), &a1->prods);
+			}
+			add_prod_to_list(prefix, &kept);
+			a->prods = reverse_linked_list(kept);
+			a1->prods = reverse_linked_list(a1->prods);
+			if (n == cap) {
+				order = mem_realloc(order, cap * sizeof(char *),
+					2 * cap * sizeof(char *), MEM_SCRATCH);
+				cap *= 2;
+			}
+			order[n++] = a1->key;
+		}
+	}
+	mem_free(order, cap * sizeof(char *), MEM_SCRATCH);
+}
+
 void fill_first_of_term_tab()
 {
 	for (enum tk_type tt = 0; tt < TK_TYPE_COUNT; tt++) {
@@ -508,434 +866,734 @@ struct sym_list *first(struct symbol *sym)
 		assert(first_of_term[sym->term_type] != NULL);
 		return first_of_term[sym->term_type];
 	}
-	/* return FIRST(nt) if it had already been computed */
+	/* FIRST(nt) is filled by compute_first_tab() */
 	struct sym_list_entry *fnte;
 	LOOK_UP(fnte, sym->nt_name, first_of_nt);
-	if (fnte != NULL) {
-		assert(fnte->sl != NULL);
-		return fnte->sl;
-	}
-	fnte = malloc(sizeof(struct sym_list_entry));
-	INSERT_ENTRY(fnte, sym->nt_name, first_of_nt);
-	fnte->sl = NULL;
-
-	int added_to_first = 1;
-	while (added_to_first) {
-
-	added_to_first = 0;
-	/* walk over every prod for sym */
-	struct prod_head_entry *phe;
-	LOOK_UP(phe, sym->nt_name, productions);
-	assert(phe != NULL);
-	struct prod_list *prdp = phe->prods;
-	assert(prdp != NULL);
-	for (; prdp != NULL; prdp = prdp->next) {
-		struct sym_list *prod = prdp->prod;
-		assert(prod != NULL);
-		assert(prod->sym != NULL);
-		/* if the prod is left-recursive, check
-		 * if FIRST(sym) already contains EMPTY_STR.
-		 * if it does, skip sym in the prod; if it
-		 * does not, skip the prod altogether.
-		 */
-		if (!sym->is_term && !prod->sym->is_term) {
-			assert(sym->nt_name != NULL);
-			assert(prod->sym->nt_name != NULL);
-			if (strcmp(prod->sym->nt_name, sym->nt_name) == 0) {
-				struct sym_list_entry *e;
-				LOOK_UP(e, sym->nt_name, first_of_nt);
-				if (e == NULL || !sym_in_sym_list(&es_sym,
-							e->sl))
-					continue;
-				prod = prod->next; /* skip sym in prod */
-				if (prod == NULL)
-					panic("redundant production %s ::= %s",
-						sym->nt_name, sym->nt_name);
-			}
-		}
-		/* add FIRST(s) for every s in the prod, stop when
-		 * FIRST(s) does not contain the EMPTY_STR (when s
-		 * cannot be reduced to the empty string).
-		 */
-		int added_es = 1;
-		for (; prod != NULL; prod = prod->next) {
-			if (!added_es)
-				break;
-			added_es = 0;
-			struct sym_list *fsl = first(prod->sym);
-			assert(fsl != NULL);
-			for (; fsl != NULL; fsl = fsl->next) {
-				if (!sym_in_sym_list(fsl->sym, fnte->sl)) {
-					add_sym_to_list(fsl->sym, &fnte->sl);
-					added_to_first = 1;
-				}
-				if (fsl->sym->is_term &&
-						fsl->sym->term_type == EMPTY_STR)
-					added_es = 1;
-			}
-		}
-	}
-
-	}
+	assert(fnte != NULL);
 	return fnte->sl;
 }
 
 void fill_nts_in_grammar_list()
 {
-	for (size_t i = 0; i < HASHSIZE; i++) {
-		if (productions[i] == NULL)
+	for (size_t i = 0; i < productions.m.cap; i++) {
+		struct prod_head_entry *phe = productions.m.slots[i].val;
+		if (phe == NULL)
 			continue;
-		struct prod_head_entry *phe = productions[i];
-		for (; phe != NULL; phe = phe->next) {
-			struct symbol *nt = make_symbol(0, 0, phe->key);
-			add_sym_to_list(nt, &nts_in_grammar);
-		}
+		struct symbol *nt = make_symbol(0, 0, phe->key);
+		add_sym_to_list(nt, &nts_in_grammar);
 	}
 }
 
-void compute_first_tab()
+/*
+ * Numbers the nonterminals in nts_in_grammar order
+ * and sets nts_n to their count.
+ */
+void fill_nt_index()
 {
-	fill_first_of_term_tab();
+	nts_n = 0;
 	struct sym_list *nts = nts_in_grammar;
-	assert(nts != NULL);
-	for (; nts != NULL; nts = nts->next)
-		first(nts->sym);
+	for (; nts != NULL; nts = nts->next) {
+		struct nt_index_entry *e = mem_alloc(sizeof(*e), MEM_ENTRY);
+		INSERT_ENTRY(e, nts->sym->nt_name, nt_index);
+		e->idx = nts_n++;
+	}
 }
 
-struct sym_list *first_of_sym_list(struct sym_list *sl)
+/*
+ * Returns the index of sym among all the symbols:
+ * terminals are indexed by their type and the
+ * nonterminals follow them, numbered by fill_nt_index().
+ */
+size_t sym_index(struct symbol *sym)
 {
-	struct sym_list *f = NULL;
-	int all_have_es = 1;
-	int had_es = 1;
-	for (; sl != NULL; sl = sl->next) {
-		assert(sl->sym != NULL);
-		if (!had_es) {
-			all_have_es = 0;
-			break;
+	if (sym->is_term)
+		return (size_t) sym->term_type;
+	struct nt_index_entry *e;
+	LOOK_UP(e, sym->nt_name, nt_index);
+	assert(e != NULL);
+	return TK_TYPE_COUNT + e->idx;
+}
+
+/*
+ * Numbers the productions grouped by nonterminal,
+ * in nts_in_grammar order, stores their bodies in
+ * prod_syms and makes their items.
+ */
+void fill_prod_tab()
+{
+	size_t syms_n = 0;
+	prods_n = 0;
+	nt_prods = mem_alloc((nts_n + 1) * sizeof(size_t), MEM_TABLE);
+	struct sym_list *nts = nts_in_grammar;
+	for (size_t j = 0; nts != NULL; nts = nts->next, j++) {
+		nt_prods[j] = prods_n;
+		struct prod_head_entry *phe;
+		LOOK_UP(phe, nts->sym->nt_name, productions);
+		assert(phe != NULL);
+		for (struct prod_list *pl = phe->prods; pl != NULL;
+							pl = pl->next) {
+			++prods_n;
+			for (struct sym_list *sl = pl->prod; sl != NULL;
+							sl = sl->next)
+				++syms_n;
 		}
-		had_es = 0;
-		struct sym_list *sf = first(sl->sym);
-		assert(sf != NULL);
-		for (; sf != NULL; sf = sf->next) {
-			struct symbol *s = sf->sym;
-			assert(s != NULL);
-			if (s->is_term && s->term_type == EMPTY_STR) {
-				had_es = 1;
-				continue;
+	}
+	nt_prods[nts_n] = prods_n;
+	if (prods_n >= (size_t) 1 << (32 - DOT_BITS))
+		panic("too many productions");
+
+	prod_syms = mem_alloc((syms_n + 1) * sizeof(uint32_t), MEM_TABLE);
+	prod_off = mem_alloc((prods_n + 1) * sizeof(size_t), MEM_TABLE);
+	prod_head = mem_alloc((prods_n + 1) * sizeof(size_t), MEM_TABLE);
+	lr0_itms = mem_alloc((syms_n + prods_n) * sizeof(struct item *),
+								MEM_TABLE);
+	size_t p = 0, off = 0;
+	nts = nts_in_grammar;
+	for (size_t j = 0; nts != NULL; nts = nts->next, j++) {
+		struct prod_head_entry *phe;
+		LOOK_UP(phe, nts->sym->nt_name, productions);
+		for (struct prod_list *pl = phe->prods; pl != NULL;
+							pl = pl->next, p++) {
+			prod_off[p] = off;
+			prod_head[p] = j;
+			size_t d = 0;
+			struct sym_list *sl = pl->prod;
+			for (; sl != NULL; sl = sl->next) {
+				struct symbol *s = sl->sym;
+				if (s->is_term && s->term_type == EMPTY_STR)
+					continue;
+				lr0_itms[ITEM_POS(p, d)] = make_item(phe->key,
+							pl->prod, sl);
+				prod_syms[off++] = (uint32_t) sym_index(s);
+				++d;
 			}
-			if (!sym_in_sym_list(s, f))
-				add_sym_to_list(s, &f);
+			if (d >= (size_t) 1 << DOT_BITS)
+				panic("production of %s is too long", phe->key);
+			lr0_itms[ITEM_POS(p, d)] = make_item(phe->key,
+							pl->prod, NULL);
 		}
 	}
-	/* add the empty string only if every symbol in
-	 * the sym_list is nullable.
-	 */
-	if (all_have_es)
-		add_sym_to_list(&es_sym, &f);
-	return f;
+	assert(p == prods_n);
+	prod_off[prods_n] = off;
+	lr0_itms_n = off + prods_n;
 }
 
-void compute_follow_tab()
+/*
+ * Fills clos_tab from the "B may begin with C" relation
+ * between nonterminals, made reflexive and transitive
+ * with Warshall's algorithm.
+ */
+void compute_clos_tab()
 {
-	struct sym_list_entry *ssfe;
-	LOOK_UP(ssfe, start_sym, follow_tab);
-	assert(ssfe == NULL);
-	ssfe = malloc(sizeof(struct sym_list_entry));
-	INSERT_ENTRY(ssfe, start_sym, follow_tab);
-	ssfe->sl = NULL;
-	/* place end of input marker (EOI) into FOLLOW(start_symbol) */
-	add_sym_to_list(&eoi_sym, &ssfe->sl);
+	size_t nt_words = BITSET_WORDS(nts_n);
+	unsigned long **left = mem_alloc(nts_n * sizeof(unsigned long *),
+								MEM_SCRATCH);
+	for (size_t j = 0; j < nts_n; j++) {
+		left[j] = make_bitset(nts_n);
+		BIT_SET(left[j], j);
+		for (size_t p = nt_prods[j]; p < nt_prods[j+1]; p++) {
+			if (PROD_LEN(p) == 0)
+				continue;
+			size_t x = prod_syms[prod_off[p]];
+			if (x >= TK_TYPE_COUNT)
+				BIT_SET(left[j], x - TK_TYPE_COUNT);
+		}
+	}
+	for (size_t k = 0; k < nts_n; k++)
+		for (size_t j = 0; j < nts_n; j++)
+			if (BIT_TEST(left[j], k))
+				bitset_or(left[j], left[k], nt_words);
+
+	clos_tab = mem_alloc(nts_n * sizeof(unsigned long *), MEM_TABLE);
+	for (size_t j = 0; j < nts_n; j++) {
+		clos_tab[j] = make_bitset(prods_n);
+		for (size_t k = 0; k < nts_n; k++) {
+			if (!BIT_TEST(left[j], k))
+				continue;
+			for (size_t p = nt_prods[k]; p < nt_prods[k+1]; p++)
+				BIT_SET(clos_tab[j], p);
+		}
+		free_bitset(left[j], nts_n);
+	}
+	mem_free(left, nts_n * sizeof(unsigned long *), MEM_SCRATCH);
+}
 
-	/* until nothing can be added to follow */
-	int added_to_follow = 1;
-	while (added_to_follow) {
+/*
+ * Fills nullable_nts. Every production keeps the count of its
+ * symbols not yet known to be nullable, and the count drops
+ * as the nonterminals are found to be nullable, so that each
+ * symbol of the grammar is visited a constant number of times.
+ */
+void compute_nullable()
+{
+	nullable_nts = make_bitset(nts_n);
+	size_t *left = mem_alloc(prods_n * sizeof(size_t), MEM_SCRATCH);
+	/* occ_off[k] to occ_off[k+1] index the productions in
+	 * occ where the k-th nonterminal occurs, once for each
+	 * occurrence.
+	 */
+	size_t *occ_off = mem_calloc(nts_n + 1, sizeof(size_t), MEM_SCRATCH);
+	for (size_t p = 0; p < prods_n; p++) {
+		left[p] = PROD_LEN(p);
+		for (size_t i = prod_off[p]; i < prod_off[p+1]; i++) {
+			if (prod_syms[i] < TK_TYPE_COUNT) {
+				left[p] = SIZE_MAX;
+				break;
+			}
+		}
+		if (left[p] == SIZE_MAX)
+			continue;
+		for (size_t i = prod_off[p]; i < prod_off[p+1]; i++)
+			++occ_off[prod_syms[i] - TK_TYPE_COUNT];
+	}
+	for (size_t k = 0; k < nts_n; k++)
+		occ_off[k+1] += occ_off[k];
+	size_t occ_n = occ_off[nts_n] + 1;
+	size_t *occ = mem_alloc(occ_n * sizeof(size_t), MEM_SCRATCH);
+	for (size_t p = prods_n; p-- > 0; ) {
+		if (left[p] == SIZE_MAX)
+			continue;
+		for (size_t i = prod_off[p]; i < prod_off[p+1]; i++)
+			occ[--occ_off[prod_syms[i] - TK_TYPE_COUNT]] = p;
+	}
 
-	added_to_follow = 0;
-	struct sym_list *ntl = nts_in_grammar;
-	assert(ntl != NULL);
+	size_t *queue = mem_alloc(nts_n * sizeof(size_t), MEM_SCRATCH);
+	size_t queue_n = 0;
+	for (size_t p = 0; p < prods_n; p++) {
+		if (left[p] != 0 || BIT_TEST(nullable_nts, prod_head[p]))
+			continue;
+		BIT_SET(nullable_nts, prod_head[p]);
+		queue[queue_n++] = prod_head[p];
+	}
+	while (queue_n > 0) {
+		size_t k = queue[--queue_n];
+		for (size_t o = occ_off[k]; o < occ_off[k+1]; o++) {
+			size_t p = occ[o];
+			if (--left[p] != 0 || BIT_TEST(nullable_nts, prod_head[p]))
+				continue;
+			BIT_SET(nullable_nts, prod_head[p]);
+			queue[queue_n++] = prod_head[p];
+		}
+	}
 
-	/* for every nonterminal */
-	for (; ntl != NULL; ntl = ntl->next) {
+	mem_free(left, prods_n * sizeof(size_t), MEM_SCRATCH);
+	mem_free(occ_off, (nts_n + 1) * sizeof(size_t), MEM_SCRATCH);
+	mem_free(occ, occ_n * sizeof(size_t), MEM_SCRATCH);
+	mem_free(queue, nts_n * sizeof(size_t), MEM_SCRATCH);
+}
 
-	struct prod_head_entry *phe;
-	LOOK_UP(phe, ntl->sym->nt_name, productions);
-	struct prod_list *prdp = phe->prods;
-	assert(prdp != NULL);
-	for (; prdp != NULL; prdp = prdp->next) {
-		struct sym_list *prod = prdp->prod;
-		assert(prod != NULL);
-		for (; prod != NULL; prod = prod->next) {
-			struct symbol *s = prod->sym;
-			assert(s != NULL);
-			if (s->is_term)
+/*
+ * Solves the set constraints "sets[j] contains sets[k]" for
+ * every edge k, from edges[edge_off[j]] to edges[edge_off[j+1]],
+ * of the j-th of n nodes, sets[j] being given with its seed.
+ * One pass of Tarjan's algorithm completes the strongly
+ * connected components in reverse topological order, so the
+ * set of every component is solved once from the seeds of its
+ * members and from the sets of the components it has edges to,
+ * and then shared by its members (the seeds are freed).
+ * The recursion is kept on explicit stacks.
+ */
+void solve_set_graph(size_t n, size_t *edge_off, size_t *edges,
+				unsigned long **sets, size_t words)
+{
+	/* num[j] is 0 until the j-th node is visited */
+	size_t *num = mem_calloc(n, sizeof(size_t), MEM_SCRATCH);
+	size_t *low = mem_alloc(n * sizeof(size_t), MEM_SCRATCH);
+	size_t *pos = mem_alloc(n * sizeof(size_t), MEM_SCRATCH);
+	char *on_stk = mem_calloc(n, 1, MEM_SCRATCH);
+	size_t *stk = mem_alloc(n * sizeof(size_t), MEM_SCRATCH), stk_n = 0;
+	size_t *call = mem_alloc(n * sizeof(size_t), MEM_SCRATCH), call_n = 0;
+	size_t visited = 0;
+	for (size_t r = 0; r < n; r++) {
+		if (num[r] != 0)
+			continue;
+		num[r] = low[r] = ++visited;
+		pos[r] = edge_off[r];
+		stk[stk_n++] = call[call_n++] = r;
+		on_stk[r] = 1;
+		while (call_n > 0) {
+			size_t v = call[call_n-1];
+			if (pos[v] < edge_off[v+1]) {
+				size_t w = edges[pos[v]++];
+				if (num[w] == 0) {
+					num[w] = low[w] = ++visited;
+					pos[w] = edge_off[w];
+					stk[stk_n++] = call[call_n++] = w;
+					on_stk[w] = 1;
+				} else if (on_stk[w] && num[w] < low[v]) {
+					low[v] = num[w];
+				}
 				continue;
-			struct sym_list_entry *sfle;
-			LOOK_UP(sfle, s->nt_name, follow_tab);
-			if (sfle == NULL) {
-				sfle = malloc(sizeof(struct sym_list_entry));
-				INSERT_ENTRY(sfle, s->nt_name, follow_tab);
 			}
-			/* if A -> xBy add {FIRST(y) - EMPTY_STR} to
-			 * FOLLOW(B) (where x and y are sym strings).
+			--call_n;
+			if (call_n > 0 && low[v] < low[call[call_n-1]])
+				low[call[call_n-1]] = low[v];
+			if (low[v] != num[v])
+				continue;
+			/* v is the root of a component made of
+			 * the nodes on stk from v up.
 			 */
-			if (prod->next != NULL) { /* if y follows B */
-				struct sym_list *strf; /* FIRST(y) */
-				strf = first_of_sym_list(prod->next);
-				for (; strf != NULL; strf = strf->next) {
-					assert(strf->sym->is_term);
-					if (strf->sym->term_type == EMPTY_STR
-						|| sym_in_sym_list(strf->sym,
-								sfle->sl))
-						continue;
-					struct sym_list *slnk;
-					slnk = malloc(sizeof(*slnk));
-					slnk->sym = strf->sym;
-					ADD_LINK(slnk, sfle->sl);
-					added_to_follow = 1;
-				}
+			size_t base = stk_n;
+			do
+				--base;
+			while (stk[base] != v);
+			unsigned long *f = make_bitset(words * WORD_BITS);
+			for (size_t m = base; m < stk_n; m++) {
+				size_t j = stk[m];
+				bitset_or(f, sets[j], words);
+				for (size_t e = edge_off[j]; e < edge_off[j+1];
+									e++)
+					if (!on_stk[edges[e]])
+						bitset_or(f, sets[edges[e]],
+								words);
 			}
-			/* if A->xB or (A->xBy and FIRST(y) has EMPTY_STR)
-			 * then add FOLLOW(A) to FOLLOW(B).
-			 */
-			if (prod->next == NULL ||
-					!sym_in_sym_list(&es_sym,
-					first_of_sym_list(prod->next))) {
-				struct sym_list_entry *phfe; /* FOLLOW(A) */
-				LOOK_UP(phfe, ntl->sym->nt_name, follow_tab);
-				if (phfe == NULL) {
-					phfe = malloc(sizeof(*phfe));
-					INSERT_ENTRY(phfe, ntl->sym->nt_name,
-								follow_tab);
-					phfe->sl = NULL;
-					continue;
-				}
-				struct sym_list *phf = phfe->sl;
-				for (; phf != NULL; phf = phf->next) {
-					if (sym_in_sym_list(phf->sym, sfle->sl))
-						continue;
-					struct sym_list *slnk;
-					slnk = malloc(sizeof(*slnk));
-					slnk->sym = phf->sym;
-					ADD_LINK(slnk, sfle->sl);
-					added_to_follow = 1;
-				}
+			for (size_t m = base; m < stk_n; m++) {
+				free_bitset(sets[stk[m]], words * WORD_BITS);
+				sets[stk[m]] = f;
+				on_stk[stk[m]] = 0;
 			}
+			stk_n = base;
 		}
 	}
 
-	}
-
-	}
+	mem_free(num, n * sizeof(size_t), MEM_SCRATCH);
+	mem_free(low, n * sizeof(size_t), MEM_SCRATCH);
+	mem_free(pos, n * sizeof(size_t), MEM_SCRATCH);
+	mem_free(on_stk, n, MEM_SCRATCH);
+	mem_free(stk, n * sizeof(size_t), MEM_SCRATCH);
+	mem_free(call, n * sizeof(size_t), MEM_SCRATCH);
 }
 
-struct itm_list *closure(struct itm_list *il)
+/*
+ * Fills first_sets from nullable_nts by solving the
+ * "B may begin with C" graph, which has an edge from
+ * B to C if some B -> xCy has a nullable x.
+ */
+void compute_first_sets()
 {
-	struct itm_list *clos = NULL;
-	/* add every item in il to clos */
-	for (; il != NULL; il = il->next) {
-		/* assert that il has no repeated items (is a set) */
-		assert(!itm_in_itm_list(il->itm, clos));
-		add_itm_to_list(il->itm, &clos);
+	/* first_sets[j] starts with the terminals the j-th
+	 * nonterminal begins with, and its edges go from
+	 * edges[edge_off[j]] to edges[edge_off[j+1]].
+	 */
+	first_sets = mem_alloc(nts_n * sizeof(unsigned long *), MEM_TABLE);
+	size_t *edge_off = mem_alloc((nts_n + 1) * sizeof(size_t), MEM_SCRATCH);
+	size_t edges_cap = prod_off[prods_n] + 1;
+	size_t *edges = mem_alloc(edges_cap * sizeof(size_t), MEM_SCRATCH);
+	size_t edges_n = 0;
+	for (size_t j = 0; j < nts_n; j++) {
+		first_sets[j] = make_bitset(TK_TYPE_COUNT);
+		edge_off[j] = edges_n;
+		for (size_t p = nt_prods[j]; p < nt_prods[j+1]; p++) {
+			for (size_t i = prod_off[p]; i < prod_off[p+1]; i++) {
+				if (prod_syms[i] < TK_TYPE_COUNT) {
+					BIT_SET(first_sets[j], prod_syms[i]);
+					break;
+				}
+				size_t k = prod_syms[i] - TK_TYPE_COUNT;
+				edges[edges_n++] = k;
+				if (!BIT_TEST(nullable_nts, k))
+					break;
+			}
+		}
 	}
+	edge_off[nts_n] = edges_n;
 
-	struct sym_list *added_nts = NULL;
-	int added_to_clos = 1;
-	while (added_to_clos) {
+	solve_set_graph(nts_n, edge_off, edges, first_sets, TERM_WORDS);
+	mem_free(edge_off, (nts_n + 1) * sizeof(size_t), MEM_SCRATCH);
+	mem_free(edges, edges_cap * sizeof(size_t), MEM_SCRATCH);
+}
 
-	added_to_clos = 0;
-	for (struct itm_list *c = clos; c != NULL; c = c->next) {
-		struct item *itm = c->itm;
-		/* if itm is of the form [ A -> x.By ]
-		 * (where A, B are nonterms and x, y are symbol strings),
-		 * then add B -> .z to clos for every production B -> z
-		 * in the grammar.
-		 */
-		if (itm->dot == NULL || itm->dot->sym->is_term)
-			continue;
-		/* since adding one item of the form [ B -> .g ] implies
-		 * adding every item [ B -> .z ] for every B production
-		 * B -> z, then it is enough to check if B is in added_nts
-		 * to know if we should skip adding B items altoghether.
-		 */
-		if (sym_in_sym_list(itm->dot->sym, added_nts))
+/* Adds the terminal of every bit set in bs to *slp. */
+void add_term_bits_to_list(const unsigned long *bs, struct sym_list **slp)
+{
+	for (size_t tt = TK_TYPE_COUNT; tt-- > 0; ) {
+		if (!BIT_TEST(bs, tt))
 			continue;
-		struct symbol *nt = itm->dot->sym;
-		struct prod_head_entry *phe;
-		LOOK_UP(phe, nt->nt_name, productions);
-		assert(phe != NULL);
-		struct prod_list *prods = phe->prods;
-		assert(prods != NULL);
-		for (; prods != NULL; prods = prods->next) {
-			struct sym_list *prod = prods->prod;
-			struct item *nitm = make_item(nt->nt_name, prod, prod);
-			assert(!itm_in_itm_list(nitm, clos));
-			add_itm_to_list(nitm, &clos);
-			added_to_clos = 1;
-		}
-		add_sym_to_list(itm->dot->sym, &added_nts);
-	}
-
+		if (tt == EOI)
+			add_sym_to_list(&eoi_sym, slp);
+		else
+			add_sym_to_list(first_of_term[tt]->sym, slp);
 	}
-
-	return clos;
 }
 
-struct itm_list *go_to(struct itm_list *il, struct symbol *sym)
+/*
+ * Fills suffix_first and nullable_suffixes from first_sets,
+ * walking every production backwards from its last item.
+ */
+void compute_suffix_first()
 {
-	struct itm_list *g = NULL;
-	/* for every item of the form [ A -> x.By ] in il add
-	 * [ A -> xB.y ] to g (where B is sym).
-	 */
-	if (sym->is_term) {
-		for (; il != NULL; il = il->next) {
-			if (il->itm->dot == NULL)
+	unsigned long *pool = mem_calloc(lr0_itms_n * TERM_WORDS,
+					sizeof(unsigned long), MEM_BITSET);
+	suffix_first = mem_alloc(lr0_itms_n * sizeof(unsigned long *),
+								MEM_TABLE);
+	nullable_suffixes = make_bitset(lr0_itms_n);
+	for (size_t x = 0; x < lr0_itms_n; x++)
+		suffix_first[x] = pool + x * TERM_WORDS;
+
+	for (size_t p = 0; p < prods_n; p++) {
+		BIT_SET(nullable_suffixes, ITEM_POS(p, PROD_LEN(p)));
+		for (size_t d = PROD_LEN(p); d-- > 0; ) {
+			size_t x = ITEM_POS(p, d), s = prod_syms[prod_off[p] + d];
+			if (s < TK_TYPE_COUNT) {
+				BIT_SET(suffix_first[x], s);
 				continue;
-			struct symbol *sfd = il->itm->dot->sym;
-			if (!sfd->is_term || sfd->term_type != sym->term_type)
+			}
+			size_t j = s - TK_TYPE_COUNT;
+			bitset_or(suffix_first[x], first_sets[j], TERM_WORDS);
+			if (!BIT_TEST(nullable_nts, j))
 				continue;
-			struct item *nit = make_item(il->itm->head,
-					il->itm->body, il->itm->dot->next);
-			assert(!itm_in_itm_list(nit, g));
-			add_itm_to_list(nit, &g);
+			bitset_or(suffix_first[x], suffix_first[x+1],
+								TERM_WORDS);
+			if (BIT_TEST(nullable_suffixes, x+1))
+				BIT_SET(nullable_suffixes, x);
 		}
-		return closure(g);
 	}
-	for (; il != NULL; il = il->next) {
-		if (il->itm->dot == NULL)
-			continue;
-		struct symbol *sfd = il->itm->dot->sym;
-		if (sfd->is_term || strcmp(sfd->nt_name, sym->nt_name) != 0)
-			continue;
-		struct item *nit = make_item(il->itm->head, il->itm->body,
-							il->itm->dot->next);
-		assert(!itm_in_itm_list(nit, g));
-		add_itm_to_list(nit, &g);
-	}
-	return closure(g);
 }
 
-struct itm_list *find_itm_list_in_canon_set(struct itm_list *itml)
+void compute_first_tab()
 {
-	struct itm_list *in_canon;
-	struct itm_list_list *c = canon_set;
+	fill_first_of_term_tab();
+	compute_nullable();
+	compute_first_sets();
+	/* fill FIRST(nt) for every nt from its first_set */
+	struct sym_list *nts = nts_in_grammar;
+	assert(nts != NULL);
+	for (size_t j = 0; nts != NULL; nts = nts->next, j++) {
+		struct sym_list_entry *fnte;
+		fnte = mem_alloc(sizeof(struct sym_list_entry), MEM_ENTRY);
+		INSERT_ENTRY(fnte, nts->sym->nt_name, first_of_nt);
+		fnte->sl = NULL;
+		if (BIT_TEST(nullable_nts, j))
+			add_sym_to_list(first_of_term[EMPTY_STR]->sym,
+								&fnte->sl);
+		add_term_bits_to_list(first_sets[j], &fnte->sl);
+	}
+	compute_suffix_first();
+}
 
-	for (; c != NULL; c = c->next) {
-		in_canon = c->il;
-		struct itm_list *il = itml;
-		for (; il != NULL; il = il->next) {
-			if (!itm_in_itm_list(il->itm, c->il)) {
-				in_canon = NULL;
-				break;
+/*
+ * Fills follow_sets and follow_tab. Every production A -> xBy
+ * seeds FOLLOW(B) with FIRST(y) - {EMPTY_STR} and, if y is
+ * nullable, gives FOLLOW(B) an edge to FOLLOW(A). FIRST(y) is
+ * read from suffix_first, so that the constraints are built in
+ * one pass over the grammar and solved by solve_set_graph().
+ */
+void compute_follow_tab()
+{
+	follow_sets = mem_alloc(nts_n * sizeof(unsigned long *), MEM_TABLE);
+	for (size_t j = 0; j < nts_n; j++)
+		follow_sets[j] = make_bitset(TK_TYPE_COUNT);
+	/* place end of input marker (EOI) into FOLLOW(start_symbol) */
+	struct symbol ss = {0, 0, start_sym};
+	BIT_SET(follow_sets[sym_index(&ss) - TK_TYPE_COUNT], EOI);
+
+	/* the edge from FOLLOW(to[e]) to FOLLOW(from[e]) */
+	size_t syms_n = prod_off[prods_n] + 1;
+	size_t *from = mem_alloc(syms_n * sizeof(size_t), MEM_SCRATCH);
+	size_t *to = mem_alloc(syms_n * sizeof(size_t), MEM_SCRATCH);
+	size_t edges_n = 0;
+	for (size_t p = 0; p < prods_n; p++) {
+		size_t j = prod_head[p];
+		for (size_t d = 0; d < PROD_LEN(p); d++) {
+			size_t s = prod_syms[prod_off[p] + d];
+			if (s < TK_TYPE_COUNT)
+				continue;
+			size_t k = s - TK_TYPE_COUNT, x = ITEM_POS(p, d+1);
+			bitset_or(follow_sets[k], suffix_first[x], TERM_WORDS);
+			if (BIT_TEST(nullable_suffixes, x) && k != j) {
+				from[edges_n] = k;
+				to[edges_n++] = j;
 			}
 		}
-		if (in_canon != NULL)
-			break;
 	}
-	return in_canon;
+
+	/* sort the edges by from into edge_off and edges */
+	size_t *edge_off = mem_calloc(nts_n + 1, sizeof(size_t), MEM_SCRATCH);
+	for (size_t e = 0; e < edges_n; e++)
+		++edge_off[from[e] + 1];
+	for (size_t j = 0; j < nts_n; j++)
+		edge_off[j+1] += edge_off[j];
+	size_t *edges = mem_alloc((edges_n + 1) * sizeof(size_t), MEM_SCRATCH);
+	for (size_t e = 0; e < edges_n; e++)
+		edges[edge_off[from[e]]++] = to[e];
+	for (size_t j = nts_n; j > 0; j--)
+		edge_off[j] = edge_off[j-1];
+	edge_off[0] = 0;
+
+	solve_set_graph(nts_n, edge_off, edges, follow_sets, TERM_WORDS);
+
+	struct sym_list *nts = nts_in_grammar;
+	for (size_t j = 0; nts != NULL; nts = nts->next, j++) {
+		struct sym_list_entry *fe = mem_alloc(sizeof(*fe), MEM_ENTRY);
+		INSERT_ENTRY(fe, nts->sym->nt_name, follow_tab);
+		fe->sl = NULL;
+		add_term_bits_to_list(follow_sets[j], &fe->sl);
+	}
+
+	mem_free(from, syms_n * sizeof(size_t), MEM_SCRATCH);
+	mem_free(to, syms_n * sizeof(size_t), MEM_SCRATCH);
+	mem_free(edge_off, (nts_n + 1) * sizeof(size_t), MEM_SCRATCH);
+	mem_free(edges, (edges_n + 1) * sizeof(size_t), MEM_SCRATCH);
 }
 
-int add_goto_to_canon_set(struct itm_list *itml, struct symbol *sym)
+/* FNV-1a over the packed items of a set */
+unsigned int hash_itms(const uint32_t *itms, size_t n)
 {
-	struct itm_list *go = go_to(itml, sym);
-	if (go == NULL)
-		return 0;
+	unsigned int h = 2166136261u;
+	for (size_t k = 0; k < n; k++) {
+		h ^= itms[k];
+		h *= 16777619u;
+	}
+	return h;
+}
 
-	struct itm_list *in_canon;
-	if (sym->is_term) {
-		in_canon = find_itm_list_in_canon_set(go);
-		if (in_canon != NULL) {
-			/* if go is already in canon_set, set the itml
-			 * goto rule for this term to the existing
-			 * itm_list in canon_set.
-			 */
-			itml->gt_term_rs[sym->term_type] = in_canon;
-			return 0;
-		}
-		/* if not found, add the computed goto to
-		 * the canon_set.
-		 */
-		struct itm_list_list *illnk;
-		illnk = malloc(sizeof(struct itm_list_list));
-		illnk->il = go;
-		ADD_LINK(illnk, canon_set);
-		/* set the itml goto rule for this term to
-		 * the newly added goto in canon_set.
-		 */
-		itml->gt_term_rs[sym->term_type] = go;
-		return 1;
-	}
-	in_canon = find_itm_list_in_canon_set(go);
-	if (in_canon != NULL) {
-		/* if go is already in canon_set, set the itml
-		 * goto_rule for this nonterm to the existing
-		 * itm_list in canon_set.
-		 */
-		struct goto_nt_rule_entry *gntre;
-		LOOK_UP(gntre, sym->nt_name, itml->gt_nt_rs);
-		if (gntre != NULL)
-			return 0;
-		gntre = malloc(sizeof(struct goto_nt_rule_entry));
-		gntre->canon_itm = in_canon;
-		INSERT_ENTRY(gntre, sym->nt_name, itml->gt_nt_rs);
-		return 0;
+int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+	return x < y ? -1 : x > y;
+}
+
+/*
+ * Returns the length of the closure of the n items of kern,
+ * a sorted set, and sets *clos to it as a sorted set: kern
+ * merged with [ B -> .z ] for every production in the union
+ * of clos_tab[B] for the [ A -> x.By ] in kern. *clos is
+ * freed with free_lr0_closure(*clos, n).
+ */
+size_t lr0_closure(const uint32_t *kern, size_t n, uint32_t **clos)
+{
+	unsigned long *added = make_bitset(prods_n);
+	for (size_t k = 0; k < n; k++) {
+		size_t p = ITEM_PROD(kern[k]), d = ITEM_DOT(kern[k]);
+		if (d == PROD_LEN(p) || prod_syms[prod_off[p] + d] < TK_TYPE_COUNT)
+			continue;
+		bitset_or(added, clos_tab[prod_syms[prod_off[p] + d]
+				- TK_TYPE_COUNT], BITSET_WORDS(prods_n));
 	}
-	/* if not found, add the computed goto to the canon_set */
-	struct itm_list_list *illnk;
-	illnk = malloc(sizeof(struct itm_list_list));
-	illnk->il = go;
-	ADD_LINK(illnk, canon_set);
-	/* set the itml goto rule for this nonterm to
-	 * the newly added goto in canon_set.
-	 */
-	struct goto_nt_rule_entry *gntre;
-	LOOK_UP(gntre, sym->nt_name, itml->gt_nt_rs);
-	if (gntre != NULL)
-		return 0;
-	gntre = malloc(sizeof(struct goto_nt_rule_entry));
-	gntre->canon_itm = go;
-	INSERT_ENTRY(gntre, sym->nt_name, itml->gt_nt_rs);
-	// TODO: all unset gt_nt_rs should be set to ACT_ERR
-	return 1;
+	uint32_t *c = mem_alloc((n + prods_n) * sizeof(uint32_t), MEM_SCRATCH);
+	size_t m = 0, k = 0;
+	for (size_t p = 0; p < prods_n; p++) {
+		if (!BIT_TEST(added, p))
+			continue;
+		for (; k < n && kern[k] < ITEM(p, 0); k++)
+			c[m++] = kern[k];
+		if (k < n && kern[k] == ITEM(p, 0))
+			++k;
+		c[m++] = ITEM(p, 0);
+	}
+	for (; k < n; k++)
+		c[m++] = kern[k];
+	free_bitset(added, prods_n);
+	*clos = c;
+	return m;
 }
 
+void free_lr0_closure(uint32_t *clos, size_t kern_n)
+{
+	mem_free(clos, (kern_n + prods_n) * sizeof(uint32_t), MEM_SCRATCH);
+}
+
+/* Returns the items of a sorted set as an itm_list in the same order. */
+struct itm_list *itm_list_of_set(const uint32_t *itms, size_t n)
+{
+	struct itm_list *il = NULL;
+	for (size_t k = n; k-- > 0; )
+		add_itm_to_list(lr0_itms[ITEM_POS(ITEM_PROD(itms[k]),
+						ITEM_DOT(itms[k]))], &il);
+	return il;
+}
+
+/*
+ * The LR(0) collection built by compute_canon_set(): the
+ * kernel of the i-th state is lr0_kerns[i], a sorted set
+ * of lr0_kern_ns[i] items, and lr0_trans[i][x] is the state
+ * reached from it on the symbol whose sym_index() is x
+ * (NO_STATE if none). lr0_kern_tab indexes the states by
+ * their kernel with open addressing, holding the state
+ * number plus one (0 for empty slots), and lr0_kern_hashes
+ * caches the hash of every kernel.
+ */
+uint32_t **lr0_kerns;
+size_t *lr0_kern_ns, **lr0_trans, lr0_n, lr0_cap;
+unsigned int *lr0_kern_hashes;
+size_t *lr0_kern_tab, lr0_kern_tab_cap;
+
+void place_lr0_kern(size_t i)
+{
+	size_t mask = lr0_kern_tab_cap - 1;
+	size_t h = lr0_kern_hashes[i] & mask;
+	while (lr0_kern_tab[h] != 0)
+		h = (h + 1) & mask;
+	lr0_kern_tab[h] = i + 1;
+}
+
+/*
+ * Returns the state whose kernel is the sorted set of
+ * n items in kern, adding it if there is none. Takes
+ * ownership of kern.
+ */
+size_t add_lr0_state(uint32_t *kern, size_t n)
+{
+	unsigned int h = hash_itms(kern, n);
+	size_t mask = lr0_kern_tab_cap - 1;
+	for (size_t t = h & mask; lr0_kern_tab[t] != 0; t = (t + 1) & mask) {
+		size_t i = lr0_kern_tab[t] - 1;
+		if (lr0_kern_hashes[i] != h || lr0_kern_ns[i] != n ||
+			memcmp(lr0_kerns[i], kern, n * sizeof(uint32_t)) != 0)
+			continue;
+		mem_free(kern, n * sizeof(uint32_t), MEM_STATE);
+		return i;
+	}
+
+	if (lr0_n == lr0_cap) {
+		size_t old = lr0_cap;
+		lr0_cap = lr0_cap ? 2*lr0_cap : 64;
+		lr0_kerns = mem_realloc(lr0_kerns, old * sizeof(uint32_t *),
+				lr0_cap * sizeof(uint32_t *), MEM_STATE);
+		lr0_kern_ns = mem_realloc(lr0_kern_ns, old * sizeof(size_t),
+				lr0_cap * sizeof(size_t), MEM_STATE);
+		lr0_trans = mem_realloc(lr0_trans, old * sizeof(size_t *),
+				lr0_cap * sizeof(size_t *), MEM_STATE);
+		lr0_kern_hashes = mem_realloc(lr0_kern_hashes,
+				old * sizeof(unsigned int),
+				lr0_cap * sizeof(unsigned int), MEM_STATE);
+	}
+	size_t i = lr0_n++;
+	lr0_kerns[i] = kern;
+	lr0_kern_ns[i] = n;
+	lr0_kern_hashes[i] = h;
+	lr0_trans[i] = mem_alloc((TK_TYPE_COUNT + nts_n) * sizeof(size_t),
+								MEM_STATE);
+	for (size_t x = 0; x < TK_TYPE_COUNT + nts_n; x++)
+		lr0_trans[i][x] = NO_STATE;
+
+	if (4 * lr0_n > 3 * lr0_kern_tab_cap) {
+		mem_free(lr0_kern_tab, lr0_kern_tab_cap * sizeof(size_t),
+								MEM_STATE);
+		lr0_kern_tab_cap = lr0_kern_tab_cap ? 2*lr0_kern_tab_cap : 128;
+		lr0_kern_tab = mem_calloc(lr0_kern_tab_cap, sizeof(size_t),
+								MEM_STATE);
+		for (size_t k = 0; k < lr0_n; k++)
+			place_lr0_kern(k);
+	} else {
+		place_lr0_kern(i);
+	}
+	return i;
+}
+
+/* lr0_adv holds (symbol after the dot, item with the dot
+ * advanced over it) pairs, sorted to group the kernels.
+ */
+uint64_t *lr0_adv;
+size_t lr0_adv_cap;
+
+/*
+ * Fills lr0_trans[i], adding the states that state i reaches.
+ * Returns the length of the closure of state i and sets *clos
+ * to it, as lr0_closure() does.
+ */
+size_t expand_lr0_state(size_t i, uint32_t **clos)
+{
+	uint32_t *c;
+	size_t n = lr0_closure(lr0_kerns[i], lr0_kern_ns[i], &c);
+	if (n > lr0_adv_cap) {
+		size_t old = lr0_adv_cap;
+		lr0_adv_cap = n > prods_n + 1 ? n : prods_n + 1;
+		lr0_adv = mem_realloc(lr0_adv, old * sizeof(uint64_t),
+				lr0_adv_cap * sizeof(uint64_t), MEM_SCRATCH);
+	}
+	uint64_t *adv = lr0_adv;
+	size_t adv_n = 0;
+	for (size_t k = 0; k < n; k++) {
+		size_t p = ITEM_PROD(c[k]), d = ITEM_DOT(c[k]);
+		if (d == PROD_LEN(p))
+			continue;
+		adv[adv_n++] = (uint64_t) prod_syms[prod_off[p] + d]
+					<< 32 | (uint64_t) (c[k] + 1);
+	}
+	qsort(adv, adv_n, sizeof(uint64_t), cmp_u64);
+	for (size_t k = 0; k < adv_n;) {
+		size_t x = (size_t) (adv[k] >> 32), kn = 0, e = k;
+		while (e < adv_n && (size_t) (adv[e] >> 32) == x)
+			++e;
+		uint32_t *kern = mem_alloc((e - k) * sizeof(uint32_t),
+							MEM_STATE);
+		for (; k < e; k++)
+			kern[kn++] = (uint32_t) adv[k];
+		size_t t = add_lr0_state(kern, kn);
+		lr0_trans[i][x] = t;
+	}
+	*clos = c;
+	return n;
+}
+
+/* Starts the LR(0) collection with the state of [ S' -> .S ]. */
+void init_lr0_states()
+{
+	lr0_kerns = NULL;
+	lr0_kern_ns = NULL;
+	lr0_trans = NULL;
+	lr0_kern_hashes = NULL;
+	lr0_n = lr0_cap = 0;
+	lr0_kern_tab_cap = 128;
+	lr0_kern_tab = mem_calloc(lr0_kern_tab_cap, sizeof(size_t), MEM_STATE);
+
+	struct symbol ss = {0, 0, start_sym};
+	size_t sp = nt_prods[sym_index(&ss) - TK_TYPE_COUNT];
+	uint32_t *sk = mem_alloc(sizeof(uint32_t), MEM_STATE);
+	sk[0] = ITEM(sp, 0);
+	add_lr0_state(sk, 1);
+}
+
+/*
+ * Builds the LR(0) collection over packed items, each state
+ * being found by its kernel, and sets canon_set to the
+ * closures of its states, in order, as itm_lists with
+ * their goto rules.
+ */
 void compute_canon_set()
 {
+	init_lr0_states();
+	struct itm_list **ils = NULL;
+	size_t ils_cap = 0;
+	for (size_t i = 0; i < lr0_n; i++) {
+		uint32_t *c;
+		size_t n = expand_lr0_state(i, &c);
+		if (ils_cap < lr0_cap) {
+			ils = mem_realloc(ils, ils_cap * sizeof(*ils),
+					lr0_cap * sizeof(*ils), MEM_SCRATCH);
+			ils_cap = lr0_cap;
+		}
+		ils[i] = itm_list_of_set(c, n);
+		free_lr0_closure(c, lr0_kern_ns[i]);
+	}
+	const char **nt_names = mem_alloc((nts_n + 1) * sizeof(const char *),
+								MEM_SCRATCH);
+	struct sym_list *nts = nts_in_grammar;
+	for (size_t j = 0; nts != NULL; nts = nts->next, j++)
+		nt_names[j] = nts->sym->nt_name;
 	canon_set = NULL;
-	/* add CLOSURE({ [S'->.S] }) to canon_set */
-	struct prod_head_entry *sphe;
-	LOOK_UP(sphe, start_sym, productions);
-	assert(sphe != NULL);
-	assert(sphe->prods->next == NULL);
-	struct item *si = make_item(start_sym, sphe->prods->prod,
-						sphe->prods->prod);
-	struct itm_list *sil = NULL;
-	add_itm_to_list(si, &sil);
-	struct itm_list_list *sill = malloc(sizeof(struct itm_list_list));
-	sill->il = closure(sil);
-	ADD_LINK(sill, canon_set);
-
-	int added_to_canon = 1;
-	while (added_to_canon) {
-
-	added_to_canon = 0;
-
-	struct itm_list_list *canon = canon_set;
-	for (; canon != NULL; canon = canon->next) {
-		for (enum tk_type tt = 0; tt < TK_TYPE_COUNT; tt++) {
-			if (!term_in_grammar[tt])
+	for (size_t i = lr0_n; i-- > 0; ) {
+		for (size_t tt = 0; tt < TK_TYPE_COUNT; tt++)
+			if (lr0_trans[i][tt] != NO_STATE)
+				ils[i]->gt_term_rs[tt] = ils[lr0_trans[i][tt]];
+		for (size_t j = 0; j < nts_n; j++) {
+			size_t t = lr0_trans[i][TK_TYPE_COUNT + j];
+			if (t == NO_STATE)
 				continue;
-			struct symbol *sym = make_symbol(1, tt, NULL);
-			if (add_goto_to_canon_set(canon->il, sym))
-				added_to_canon = 1;
+			struct goto_nt_rule_entry *gntre;
+			gntre = mem_alloc(sizeof(struct goto_nt_rule_entry),
+								MEM_ENTRY);
+			gntre->canon_itm = ils[t];
+			INSERT_ENTRY(gntre, nt_names[j], ils[i]->gt_nt_rs);
 		}
-		struct sym_list *nts = nts_in_grammar;
-		for (; nts != NULL; nts = nts->next) {
-			if (add_goto_to_canon_set(canon->il, nts->sym))
-				added_to_canon = 1;
-		}
-	}
-
+		struct itm_list_list *illnk;
+		illnk = mem_alloc(sizeof(struct itm_list_list), MEM_ITM_LIST);
+		illnk->il = ils[i];
+		ADD_LINK(illnk, canon_set);
 	}
+	mem_free(nt_names, (nts_n + 1) * sizeof(const char *), MEM_SCRATCH);
+	mem_free(ils, ils_cap * sizeof(*ils), MEM_SCRATCH);
 }
 
 void compute_canon_coll()
@@ -947,7 +1605,8 @@ void compute_canon_coll()
 		c = c->next;
 	}
 
-	canon_coll = malloc(sizeof(struct itm_list *) * canon_coll_n);
+	canon_coll = mem_alloc(sizeof(struct itm_list *) * canon_coll_n,
+								MEM_TABLE);
 	c = canon_set;
 	for (size_t i = 0; i < canon_coll_n; i++) {
 		canon_coll[i] = c->il;
@@ -956,33 +1615,141 @@ void compute_canon_coll()
 	assert(c == NULL);
 }
 
-/* Returns the canon_coll index for an itm_list.
- * Returns canon_coll_n (out of bounds index)
- * if the itm_list is not in canon_coll.
+/*
+ * Returns the precedence of a production, which
+ * is the precedence of its rightmost terminal,
+ * or 0 if that terminal has none.
  */
-size_t get_state_index(struct itm_list *il)
+int prod_prec(struct sym_list *prod)
 {
-	size_t i;
-	for (i = 0; i < canon_coll_n; i++)
-		if (canon_coll[i] == il)
-			return i;
-	return canon_coll_n;
+	int prec = 0;
+	for (; prod != NULL; prod = prod->next) {
+		assert(prod->sym != NULL);
+		if (prod->sym->is_term && prod->sym->term_type != EMPTY_STR)
+			prec = term_prec[prod->sym->term_type];
+	}
+	return prec;
 }
 
-void compute_action_tab()
+/*
+ * Resolves the conflict in state i between shifting
+ * tt to state shift_to and reducing rt -> rf, and
+ * stores the winning action in act:
+ * the production wins if its precedence is higher
+ * than that of tt, the shift wins if it is lower.
+ * On equal precedences, %left reduces, %right shifts
+ * and %nonassoc makes tt an error.
+ * Panics if either side has no precedence.
+ */
+void resolve_shift_reduce(struct action_entry *act, size_t i,
+		enum tk_type tt, size_t shift_to,
+		const char *rt, struct sym_list *rf)
+{
+	int tp = term_prec[tt];
+	int pp = prod_prec(rf);
+	if (!tp || !pp)
+		panic("shift-reduce conflict in state %zu on %d", i, tt);
+	if (tp > pp || (tp == pp && term_assoc[tt] == ASSOC_RIGHT)) {
+		act->type = ACT_SHFT;
+		act->shift_to = shift_to;
+		return;
+	}
+	if (tp < pp || term_assoc[tt] == ASSOC_LEFT) {
+		act->type = ACT_RED;
+		act->reduce_to = rt;
+		act->reduce_from = rf;
+		return;
+	}
+	assert(term_assoc[tt] == ASSOC_NONASSOC);
+	act->type = ACT_ERR;
+}
+
+/*
+ * Sets action_tab[i][tt] to reduce rt -> rf, resolving
+ * shift-reduce conflicts with the declared precedences.
+ */
+void add_reduce_action(size_t i, enum tk_type tt,
+		const char *rt, struct sym_list *rf)
 {
-	action_tab = malloc(canon_coll_n * sizeof(struct action_entry **));
+	struct action_entry *act = action_tab[i][tt];
+	if (!act->type) {
+		act->type = ACT_RED;
+		act->reduce_to = rt;
+		act->reduce_from = rf;
+		return;
+	}
+	/* resolve shift-reduce conflicts */
+	if (act->type == ACT_SHFT) {
+		resolve_shift_reduce(act, i, tt, act->shift_to, rt, rf);
+		return;
+	}
+	/* already resolved by %nonassoc */
+	if (act->type == ACT_ERR)
+		return;
+	/* check for reduce-reduce conflicts */
+	assert(act->type == ACT_RED);
+	assert(act->reduce_to == rt);
+	assert(act->reduce_from == rf);
+}
+
+/*
+ * Sets action_tab[i][tt] to shift to state `to`, resolving
+ * shift-reduce conflicts with the declared precedences.
+ */
+void add_shift_action(size_t i, enum tk_type tt, size_t to)
+{
+	struct action_entry *act = action_tab[i][tt];
+	if (!act->type) {
+		act->type = ACT_SHFT;
+		act->shift_to = to;
+		return;
+	}
+	/* resolve shift-reduce conflicts */
+	if (act->type == ACT_RED) {
+		resolve_shift_reduce(act, i, tt, to,
+				act->reduce_to, act->reduce_from);
+		return;
+	}
+	/* already resolved by %nonassoc */
+	if (act->type == ACT_ERR)
+		return;
+	assert(act->type == ACT_SHFT);
+	assert(act->shift_to == to);
+}
+
+/*
+ * Allocates action_tab for canon_coll_n states
+ * with every entry unset.
+ */
+void alloc_action_tab()
+{
+	action_tab = mem_alloc(canon_coll_n * sizeof(struct action_entry **),
+								MEM_TABLE);
 	for (size_t i = 0; i < canon_coll_n; i++) {
 		/* allocate space for entries in action_tab[i]
 		 * and initialize them to 0.
 		 */
-		action_tab[i] = malloc(TK_TYPE_COUNT *
-				sizeof(struct action_entry *));
-		for (enum tk_type tt = 0; tt < TK_TYPE_COUNT; tt++) {
-			action_tab[i][tt] = malloc(sizeof(struct action_entry));
-			memset(action_tab[i][tt],0,sizeof(struct action_entry));
-		}
+		action_tab[i] = mem_alloc(TK_TYPE_COUNT *
+				sizeof(struct action_entry *), MEM_TABLE);
+		for (enum tk_type tt = 0; tt < TK_TYPE_COUNT; tt++)
+			action_tab[i][tt] = mem_calloc(1,
+				sizeof(struct action_entry), MEM_ACTION);
+	}
+}
+
+/* sets all the unset entries of action_tab[i] to error */
+void fill_action_errs(size_t i)
+{
+	for (enum tk_type tt = 0; tt < TK_TYPE_COUNT; tt++) {
+		if (!action_tab[i][tt]->type)
+			action_tab[i][tt]->type = ACT_ERR;
+	}
+}
 
+void compute_action_tab()
+{
+	alloc_action_tab();
+	for (size_t i = 0; i < canon_coll_n; i++) {
 		struct itm_list *curr_it = canon_coll[i];
 		for (; curr_it != NULL; curr_it = curr_it->next) {
 			struct item *citm = curr_it->itm;
@@ -997,60 +1764,1000 @@ void compute_action_tab()
 					action_tab[i][EOI]->type = ACT_ACC;
 					continue;
 				}
-				const char *rt = citm->head;
-				struct sym_list *rf = citm->body;
 				struct sym_list_entry *foh;
 				LOOK_UP(foh, citm->head, follow_tab);
 				struct sym_list *fsl = foh->sl;
 				for (; fsl != NULL; fsl = fsl->next) {
 					assert(fsl->sym->is_term);
-					enum tk_type tt = fsl->sym->term_type;
-					struct action_entry *act;
-					act = action_tab[i][tt];
-					if (!act->type) {
-						act->type = ACT_RED;
-						act->reduce_to = rt;
-						act->reduce_from = rf;
-						continue;
-					}
-					/* check for shift-reduce conflicts */
-					assert(act->type == ACT_RED);
-					assert(act->reduce_to == rt);
-					assert(act->reduce_from == rf);
+					add_reduce_action(i, fsl->sym->term_type,
+							citm->head, citm->body);
 				}
 				continue;
 			}
-			/* if [A -> x.ay] is in canon_coll[i], and
-			 * canon_coll[i]->gt_term_rs[a] is canon_coll[j],
-			 * then set action_tab[i][a] to shift_to j.
-			 */
-			if (!citm->dot->sym->is_term)
+		}
+		/* if [A -> x.ay] is in canon_coll[i], and state i goes
+		 * to state j on a, then set action_tab[i][a] to shift_to j.
+		 */
+		for (enum tk_type tt = 0; tt < TK_TYPE_COUNT; tt++)
+			if (lr0_trans[i][tt] != NO_STATE)
+				add_shift_action(i, tt, lr0_trans[i][tt]);
+		fill_action_errs(i);
+	}
+}
+
+void compute_goto_tab()
+{
+	goto_tab = mem_alloc(canon_coll_n * sizeof(size_t *), MEM_TABLE);
+	for (size_t i = 0; i < canon_coll_n; i++) {
+		goto_tab[i] = mem_alloc(nts_n * sizeof(size_t), MEM_TABLE);
+		for (size_t j = 0; j < nts_n; j++) {
+			size_t t = lr0_trans[i][TK_TYPE_COUNT + j];
+			goto_tab[i][j] = t == NO_STATE ? canon_coll_n : t;
+		}
+	}
+}
+
+/*
+ * Lazy tables: parse_bn_lazy() builds the start state only, and
+ * the first lazy_action() on a state computes its transitions
+ * and its action row, which action_tab[i] is NULL until then.
+ * Gotos come from lr0_trans. lazy_cap is the number of rows
+ * action_tab has room for, lazy_n the number of rows built.
+ */
+size_t lazy_cap, lazy_n;
+
+void lazy_expand(size_t i)
+{
+	uint32_t *c;
+	size_t n = expand_lr0_state(i, &c);
+	if (lr0_cap > lazy_cap) {
+		action_tab = mem_realloc(action_tab,
+			lazy_cap * sizeof(struct action_entry **),
+			lr0_cap * sizeof(struct action_entry **), MEM_TABLE);
+		for (; lazy_cap < lr0_cap; lazy_cap++)
+			action_tab[lazy_cap] = NULL;
+	}
+	action_tab[i] = mem_alloc(TK_TYPE_COUNT *
+			sizeof(struct action_entry *), MEM_TABLE);
+	for (enum tk_type tt = 0; tt < TK_TYPE_COUNT; tt++)
+		action_tab[i][tt] = mem_calloc(1,
+			sizeof(struct action_entry), MEM_ACTION);
+	++lazy_n;
+
+	struct symbol ss = {0, 0, start_sym};
+	size_t start_nt = sym_index(&ss) - TK_TYPE_COUNT;
+	for (size_t k = 0; k < n; k++) {
+		size_t p = ITEM_PROD(c[k]);
+		if (ITEM_DOT(c[k]) != PROD_LEN(p))
+			continue;
+		/* as in compute_action_tab() */
+		if (prod_head[p] == start_nt) {
+			action_tab[i][EOI]->type = ACT_ACC;
+			continue;
+		}
+		struct item *itm = lr0_itms[ITEM_POS(p, 0)];
+		for (enum tk_type tt = 0; tt < TK_TYPE_COUNT; tt++)
+			if (BIT_TEST(follow_sets[prod_head[p]], tt))
+				add_reduce_action(i, tt, itm->head, itm->body);
+	}
+	free_lr0_closure(c, lr0_kern_ns[i]);
+	for (enum tk_type tt = 0; tt < TK_TYPE_COUNT; tt++)
+		if (lr0_trans[i][tt] != NO_STATE)
+			add_shift_action(i, tt, lr0_trans[i][tt]);
+	fill_action_errs(i);
+}
+
+struct action_entry *lazy_action(size_t i, enum tk_type tt)
+{
+	if (action_tab[i] == NULL)
+		lazy_expand(i);
+	return action_tab[i][tt];
+}
+
+/* Returns the state reached from state i on the j-th nonterminal. */
+size_t lazy_goto(size_t i, size_t j)
+{
+	size_t t = lr0_trans[i][TK_TYPE_COUNT + j];
+	assert(t != NO_STATE);
+	return t;
+}
+
+/*
+ * Parses the tokens read from in, in the format parser.py
+ * reads, with the lazy tables of parse_bn_lazy(), printing
+ * every reduction if verbose is set. Returns 1 if the input
+ * is accepted, 0 on a syntax error.
+ */
+int lazy_parse(FILE *in, int verbose)
+{
+	size_t cap = 256, n = 0;
+	size_t *stack = mem_alloc(cap * sizeof(size_t), MEM_SCRATCH);
+	int tt, acc = -1;
+	stack[n++] = 0;
+	if (fscanf(in, "%d\t%*[^\n]", &tt) != 1)
+		tt = EOI;
+	while (acc < 0) {
+		if (tt < 0 || tt >= TK_TYPE_COUNT)
+			panic("bad token type %d", tt);
+		struct action_entry *act = lazy_action(stack[n-1], tt);
+		switch (act->type) {
+		case ACT_SHFT:
+			if (n == cap) {
+				stack = mem_realloc(stack, cap * sizeof(size_t),
+					2 * cap * sizeof(size_t), MEM_SCRATCH);
+				cap *= 2;
+			}
+			stack[n++] = act->shift_to;
+			if (fscanf(in, "%d\t%*[^\n]", &tt) != 1)
+				tt = EOI;
+			break;
+		case ACT_RED:
+			for (struct sym_list *sl = act->reduce_from; sl != NULL;
+							sl = sl->next)
+				if (!sl->sym->is_term ||
+					sl->sym->term_type != EMPTY_STR)
+					--n;
+			struct symbol rs = {0, 0, act->reduce_to};
+			stack[n] = lazy_goto(stack[n-1],
+					sym_index(&rs) - TK_TYPE_COUNT);
+			++n;
+			if (verbose) {
+				printf("%s -> ", act->reduce_to);
+				print_sym_list(act->reduce_from);
+				putchar('\n');
+			}
+			break;
+		case ACT_ACC:
+			acc = 1;
+			break;
+		default:
+			acc = 0;
+		}
+	}
+	mem_free(stack, cap * sizeof(size_t), MEM_SCRATCH);
+	return acc;
+}
+
+/*
+ * Compares the rows of states i and k ignoring where their
+ * shifts and gotos lead: two states compare equal if they
+ * accept, reduce by the same production, shift, or fail on
+ * the same terminals and have gotos on the same nonterminals.
+ */
+int cmp_state_rows(size_t i, size_t k)
+{
+	for (enum tk_type tt = 0; tt < TK_TYPE_COUNT; tt++) {
+		struct action_entry *a = action_tab[i][tt];
+		struct action_entry *b = action_tab[k][tt];
+		if (a->type != b->type)
+			return a->type < b->type ? -1 : 1;
+		if (a->type == ACT_RED && a->reduce_from != b->reduce_from)
+			return a->reduce_from < b->reduce_from ? -1 : 1;
+	}
+	for (size_t j = 0; j < nts_n; j++) {
+		int ga = goto_tab[i][j] < canon_coll_n;
+		int gb = goto_tab[k][j] < canon_coll_n;
+		if (ga != gb)
+			return ga - gb;
+	}
+	return 0;
+}
+
+int cmp_state_indexes(const void *a, const void *b)
+{
+	size_t i = *(const size_t *) a, k = *(const size_t *) b;
+	int c = cmp_state_rows(i, k);
+	if (c != 0)
+		return c;
+	return i < k ? -1 : i > k;
+}
+
+/* A transition into a state, on the terminal or
+ * nonterminal numbered sym, from state `from`.
+ */
+struct trans {
+	size_t sym;
+	size_t from;
+};
+
+int cmp_trans(const void *a, const void *b)
+{
+	const struct trans *ta = a, *tb = b;
+	if (ta->sym != tb->sym)
+		return ta->sym < tb->sym ? -1 : 1;
+	return ta->from < tb->from ? -1 : ta->from > tb->from;
+}
+
+/*
+ * Refinable partition of the states: the members of block b
+ * are elems[first[b]] to elems[end[b] - 1], and the marked
+ * ones come before elems[mid[b]].
+ */
+struct partition {
+	size_t *elems, *loc, *blk;
+	size_t *first, *mid, *end;
+	size_t blk_n;
+	size_t *touched;
+	size_t touched_n;
+};
+
+void mark_state(struct partition *pt, size_t p)
+{
+	size_t b = pt->blk[p];
+	size_t i = pt->loc[p], j = pt->mid[b];
+	if (i < j)
+		return;
+	pt->elems[i] = pt->elems[j];
+	pt->loc[pt->elems[i]] = i;
+	pt->elems[j] = p;
+	pt->loc[p] = j;
+	if (pt->mid[b]++ == pt->first[b])
+		pt->touched[pt->touched_n++] = b;
+}
+
+/*
+ * Splits the marked states of b into a new block,
+ * unmarks every state of b and returns the new block,
+ * or pt->blk_n if every state (or none) was marked.
+ */
+size_t split_block(struct partition *pt, size_t b)
+{
+	if (pt->mid[b] == pt->end[b] || pt->mid[b] == pt->first[b]) {
+		pt->mid[b] = pt->first[b];
+		return pt->blk_n;
+	}
+	size_t nb = pt->blk_n++;
+	pt->first[nb] = pt->mid[nb] = pt->first[b];
+	pt->end[nb] = pt->mid[b];
+	pt->first[b] = pt->mid[b];
+	for (size_t i = pt->first[nb]; i < pt->end[nb]; i++)
+		pt->blk[pt->elems[i]] = nb;
+	return nb;
+}
+
+/*
+ * Merges equivalent states, i.e. states with the same
+ * reductions whose shifts and gotos lead to equivalent
+ * states, with Hopcroft's partition refinement and
+ * renumbers action_tab, goto_tab and canon_coll.
+ */
+void minimize_states()
+{
+	size_t n = canon_coll_n;
+	if (n == 0)
+		return;
+	struct partition pt;
+	pt.elems = mem_alloc(n * sizeof(size_t), MEM_SCRATCH);
+	pt.loc = mem_alloc(n * sizeof(size_t), MEM_SCRATCH);
+	pt.blk = mem_alloc(n * sizeof(size_t), MEM_SCRATCH);
+	pt.first = mem_alloc(n * sizeof(size_t), MEM_SCRATCH);
+	pt.mid = mem_alloc(n * sizeof(size_t), MEM_SCRATCH);
+	pt.end = mem_alloc(n * sizeof(size_t), MEM_SCRATCH);
+	pt.touched = mem_alloc(n * sizeof(size_t), MEM_SCRATCH);
+	pt.touched_n = 0;
+
+	/* the initial blocks group states with equal rows */
+	for (size_t i = 0; i < n; i++)
+		pt.elems[i] = i;
+	qsort(pt.elems, n, sizeof(size_t), cmp_state_indexes);
+	pt.blk_n = 0;
+	for (size_t i = 0; i < n; i++) {
+		size_t p = pt.elems[i];
+		pt.loc[p] = i;
+		if (i == 0 || cmp_state_rows(pt.elems[i-1], p) != 0) {
+			if (pt.blk_n > 0)
+				pt.end[pt.blk_n - 1] = i;
+			pt.first[pt.blk_n] = pt.mid[pt.blk_n] = i;
+			++pt.blk_n;
+		}
+		pt.blk[p] = pt.blk_n - 1;
+	}
+	pt.end[pt.blk_n - 1] = n;
+
+	/* in_trs[in_off[q]] to in_trs[in_off[q+1] - 1]
+	 * are the transitions into state q.
+	 */
+	size_t *in_off = mem_calloc(n + 1, sizeof(size_t), MEM_SCRATCH);
+	for (size_t p = 0; p < n; p++) {
+		for (enum tk_type tt = 0; tt < TK_TYPE_COUNT; tt++)
+			if (action_tab[p][tt]->type == ACT_SHFT)
+				++in_off[action_tab[p][tt]->shift_to + 1];
+		for (size_t j = 0; j < nts_n; j++)
+			if (goto_tab[p][j] < n)
+				++in_off[goto_tab[p][j] + 1];
+	}
+	for (size_t q = 0; q < n; q++)
+		in_off[q + 1] += in_off[q];
+	size_t trs_n = in_off[n] + 1;
+	struct trans *in_trs = mem_alloc(trs_n * sizeof(struct trans),
+								MEM_SCRATCH);
+	size_t *fill = mem_alloc(n * sizeof(size_t), MEM_SCRATCH);
+	memcpy(fill, in_off, n * sizeof(size_t));
+	for (size_t p = 0; p < n; p++) {
+		for (enum tk_type tt = 0; tt < TK_TYPE_COUNT; tt++) {
+			if (action_tab[p][tt]->type != ACT_SHFT)
+				continue;
+			size_t q = action_tab[p][tt]->shift_to;
+			in_trs[fill[q]++] = (struct trans) {(size_t) tt, p};
+		}
+		for (size_t j = 0; j < nts_n; j++) {
+			size_t q = goto_tab[p][j];
+			if (q < n)
+				in_trs[fill[q]++] =
+					(struct trans) {TK_TYPE_COUNT + j, p};
+		}
+	}
+
+	/* refine with every block as a splitter */
+	size_t *work = mem_alloc(n * sizeof(size_t), MEM_SCRATCH);
+	int *in_work = mem_calloc(n, sizeof(int), MEM_SCRATCH);
+	size_t work_n = 0;
+	for (size_t b = 0; b < pt.blk_n; b++) {
+		work[work_n++] = b;
+		in_work[b] = 1;
+	}
+	struct trans *splt = mem_alloc(trs_n * sizeof(struct trans),
+								MEM_SCRATCH);
+	while (work_n > 0) {
+		size_t s = work[--work_n];
+		in_work[s] = 0;
+		/* gather the transitions into s, grouped by symbol */
+		size_t splt_n = 0;
+		for (size_t i = pt.first[s]; i < pt.end[s]; i++) {
+			size_t q = pt.elems[i];
+			for (size_t e = in_off[q]; e < in_off[q + 1]; e++)
+				splt[splt_n++] = in_trs[e];
+		}
+		qsort(splt, splt_n, sizeof(struct trans), cmp_trans);
+		for (size_t e = 0; e < splt_n;) {
+			size_t sym = splt[e].sym;
+			for (; e < splt_n && splt[e].sym == sym; e++)
+				mark_state(&pt, splt[e].from);
+			for (size_t t = 0; t < pt.touched_n; t++) {
+				size_t b = pt.touched[t];
+				size_t nb = split_block(&pt, b);
+				if (nb == pt.blk_n)
+					continue;
+				if (in_work[b]) {
+					work[work_n++] = nb;
+					in_work[nb] = 1;
+					continue;
+				}
+				size_t sb = pt.end[b] - pt.first[b];
+				size_t snb = pt.end[nb] - pt.first[nb];
+				size_t add = sb < snb ? b : nb;
+				work[work_n++] = add;
+				in_work[add] = 1;
+			}
+			pt.touched_n = 0;
+		}
+	}
+
+	/* number the blocks in the order of their first state */
+	size_t *new_idx = mem_alloc(pt.blk_n * sizeof(size_t), MEM_SCRATCH);
+	for (size_t b = 0; b < pt.blk_n; b++)
+		new_idx[b] = pt.blk_n;
+	size_t new_n = 0;
+	struct itm_list **new_coll = mem_alloc(pt.blk_n * sizeof(*new_coll),
+								MEM_TABLE);
+	struct action_entry ***new_act = mem_alloc(pt.blk_n * sizeof(*new_act),
+								MEM_TABLE);
+	size_t **new_goto = mem_alloc(pt.blk_n * sizeof(*new_goto), MEM_TABLE);
+	for (size_t p = 0; p < n; p++) {
+		size_t b = pt.blk[p];
+		if (new_idx[b] != pt.blk_n)
+			continue;
+		new_idx[b] = new_n;
+		new_coll[new_n] = canon_coll[p];
+		new_act[new_n] = action_tab[p];
+		new_goto[new_n] = goto_tab[p];
+		++new_n;
+	}
+	assert(new_n == pt.blk_n);
+	for (size_t i = 0; i < new_n; i++) {
+		for (enum tk_type tt = 0; tt < TK_TYPE_COUNT; tt++) {
+			struct action_entry *act = new_act[i][tt];
+			if (act->type == ACT_SHFT)
+				act->shift_to = new_idx[pt.blk[act->shift_to]];
+		}
+		for (size_t j = 0; j < nts_n; j++) {
+			if (new_goto[i][j] < n)
+				new_goto[i][j] = new_idx[pt.blk[new_goto[i][j]]];
+			else
+				new_goto[i][j] = new_n;
+		}
+	}
+	/* the goto rules lead to the merged states: a shift on tt
+	 * that lost to a reduction or %nonassoc leaves no rule.
+	 */
+	for (size_t i = 0; i < new_n; i++) {
+		struct itm_list *il = new_coll[i];
+		if (il == NULL)
+			continue;
+		for (enum tk_type tt = 0; tt < TK_TYPE_COUNT; tt++) {
+			struct action_entry *act = new_act[i][tt];
+			il->gt_term_rs[tt] = act->type == ACT_SHFT ?
+						new_coll[act->shift_to] : NULL;
+		}
+		struct sym_list *nts = nts_in_grammar;
+		for (size_t j = 0; j < nts_n; j++, nts = nts->next) {
+			struct goto_nt_rule_entry *gntre;
+			LOOK_UP(gntre, nts->sym->nt_name, il->gt_nt_rs);
+			if (gntre != NULL)
+				gntre->canon_itm = new_coll[new_goto[i][j]];
+		}
+	}
+	/* free the rows of the states merged into others */
+	for (size_t p = 0; p < n; p++) {
+		if (new_act[new_idx[pt.blk[p]]] == action_tab[p])
+			continue;
+		for (enum tk_type tt = 0; tt < TK_TYPE_COUNT; tt++)
+			mem_free(action_tab[p][tt],
+				sizeof(struct action_entry), MEM_ACTION);
+		mem_free(action_tab[p], TK_TYPE_COUNT *
+				sizeof(struct action_entry *), MEM_TABLE);
+		mem_free(goto_tab[p], nts_n * sizeof(size_t), MEM_TABLE);
+	}
+	mem_free(canon_coll, n * sizeof(*canon_coll), MEM_TABLE);
+	mem_free(action_tab, n * sizeof(*action_tab), MEM_TABLE);
+	mem_free(goto_tab, n * sizeof(*goto_tab), MEM_TABLE);
+	canon_coll = new_coll;
+	action_tab = new_act;
+	goto_tab = new_goto;
+	canon_coll_n = new_n;
+
+	mem_free(pt.elems, n * sizeof(size_t), MEM_SCRATCH);
+	mem_free(pt.loc, n * sizeof(size_t), MEM_SCRATCH);
+	mem_free(pt.blk, n * sizeof(size_t), MEM_SCRATCH);
+	mem_free(pt.first, n * sizeof(size_t), MEM_SCRATCH);
+	mem_free(pt.mid, n * sizeof(size_t), MEM_SCRATCH);
+	mem_free(pt.end, n * sizeof(size_t), MEM_SCRATCH);
+	mem_free(pt.touched, n * sizeof(size_t), MEM_SCRATCH);
+	mem_free(in_off, (n + 1) * sizeof(size_t), MEM_SCRATCH);
+	mem_free(in_trs, trs_n * sizeof(struct trans), MEM_SCRATCH);
+	mem_free(fill, n * sizeof(size_t), MEM_SCRATCH);
+	mem_free(work, n * sizeof(size_t), MEM_SCRATCH);
+	mem_free(in_work, n * sizeof(int), MEM_SCRATCH);
+	mem_free(splt, trs_n * sizeof(struct trans), MEM_SCRATCH);
+	mem_free(new_idx, pt.blk_n * sizeof(size_t), MEM_SCRATCH);
+}
+
+/*
+ * term_class[tt] is the class of terminal tt, terminals
+ * of the same class having equal columns in action_tab,
+ * and class_tab[i][c] is the action of state i on the
+ * terminals of class c. Terminals not in the grammar
+ * all fall in one class of errors.
+ */
+size_t term_class[TK_TYPE_COUNT], term_classes_n;
+struct action_entry ***class_tab;
+
+/* Compares the columns of terminals ta and tb in action_tab. */
+int cmp_term_cols(enum tk_type ta, enum tk_type tb)
+{
+	for (size_t i = 0; i < canon_coll_n; i++) {
+		struct action_entry *x = action_tab[i][ta];
+		struct action_entry *y = action_tab[i][tb];
+		if (x->type != y->type)
+			return x->type < y->type ? -1 : 1;
+		if (x->type == ACT_SHFT && x->shift_to != y->shift_to)
+			return x->shift_to < y->shift_to ? -1 : 1;
+		if (x->type == ACT_RED && x->reduce_from != y->reduce_from)
+			return x->reduce_from < y->reduce_from ? -1 : 1;
+	}
+	return 0;
+}
+
+int cmp_terms_by_col(const void *a, const void *b)
+{
+	enum tk_type ta = *(const enum tk_type *) a;
+	enum tk_type tb = *(const enum tk_type *) b;
+	int c = cmp_term_cols(ta, tb);
+	if (c != 0)
+		return c;
+	return ta < tb ? -1 : ta > tb;
+}
+
+/*
+ * Groups the terminals with equal columns in action_tab
+ * into classes, numbered in the order of their first
+ * terminal, and fills term_class and class_tab.
+ * The entries of class_tab are those of action_tab.
+ */
+void compute_term_classes()
+{
+	enum tk_type cols[TK_TYPE_COUNT];
+	for (size_t tt = 0; tt < TK_TYPE_COUNT; tt++)
+		cols[tt] = (enum tk_type) tt;
+	qsort(cols, TK_TYPE_COUNT, sizeof(enum tk_type), cmp_terms_by_col);
+
+	/* rep[tt] is the first terminal of the class of tt,
+	 * the classes being runs of cols, sorted by terminal.
+	 */
+	enum tk_type rep[TK_TYPE_COUNT];
+	for (size_t k = 0; k < TK_TYPE_COUNT; k++) {
+		if (k > 0 && cmp_term_cols(cols[k-1], cols[k]) == 0)
+			rep[cols[k]] = rep[cols[k-1]];
+		else
+			rep[cols[k]] = cols[k];
+	}
+
+	term_classes_n = 0;
+	enum tk_type class_rep[TK_TYPE_COUNT];
+	for (size_t tt = 0; tt < TK_TYPE_COUNT; tt++) {
+		if (rep[tt] == tt) {
+			class_rep[term_classes_n] = (enum tk_type) tt;
+			term_class[tt] = term_classes_n++;
+		} else {
+			term_class[tt] = term_class[rep[tt]];
+		}
+	}
+
+	class_tab = mem_alloc(canon_coll_n * sizeof(struct action_entry **),
+								MEM_TABLE);
+	for (size_t i = 0; i < canon_coll_n; i++) {
+		class_tab[i] = mem_alloc(term_classes_n *
+				sizeof(struct action_entry *), MEM_TABLE);
+		for (size_t c = 0; c < term_classes_n; c++)
+			class_tab[i][c] = action_tab[i][class_rep[c]];
+	}
+}
+
+/*
+ * Parses the tokens read from in, in the format parser.py
+ * reads, with the tables of parse_bn(), printing every
+ * reduction if verbose is set. The actions are looked up
+ * by the class of the token, as _lrdriver does. Returns 1
+ * if the input is accepted, 0 on a syntax error.
+ */
+int lr_parse(FILE *in, int verbose)
+{
+	size_t cap = 256, n = 0;
+	size_t *stack = mem_alloc(cap * sizeof(size_t), MEM_SCRATCH);
+	int tt, acc = -1;
+	stack[n++] = 0;
+	if (fscanf(in, "%d\t%*[^\n]", &tt) != 1)
+		tt = EOI;
+	while (acc < 0) {
+		if (tt < 0 || tt >= TK_TYPE_COUNT)
+			panic("bad token type %d", tt);
+		struct action_entry *act = class_tab[stack[n-1]][term_class[tt]];
+		switch (act->type) {
+		case ACT_SHFT:
+			if (n == cap) {
+				stack = mem_realloc(stack, cap * sizeof(size_t),
+					2 * cap * sizeof(size_t), MEM_SCRATCH);
+				cap *= 2;
+			}
+			stack[n++] = act->shift_to;
+			if (fscanf(in, "%d\t%*[^\n]", &tt) != 1)
+				tt = EOI;
+			break;
+		case ACT_RED:
+			for (struct sym_list *sl = act->reduce_from; sl != NULL;
+							sl = sl->next)
+				if (!sl->sym->is_term ||
+					sl->sym->term_type != EMPTY_STR)
+					--n;
+			struct symbol rs = {0, 0, act->reduce_to};
+			stack[n] = goto_tab[stack[n-1]][sym_index(&rs) -
+							TK_TYPE_COUNT];
+			++n;
+			if (verbose) {
+				printf("%s -> ", act->reduce_to);
+				print_sym_list(act->reduce_from);
+				putchar('\n');
+			}
+			break;
+		case ACT_ACC:
+			acc = 1;
+			break;
+		default:
+			acc = 0;
+		}
+	}
+	mem_free(stack, cap * sizeof(size_t), MEM_SCRATCH);
+	return acc;
+}
+
+/*
+ * A state of the LR(1) collection. kern holds its kernel
+ * items as a sorted set and looks[k] is the set of
+ * lookaheads of kern[k]. trans[x] is the state reached on
+ * the symbol whose sym_index() is x (NO_STATE if none).
+ */
+struct lr1_state {
+	size_t idx;
+	uint32_t *kern;
+	unsigned long **looks;
+	size_t kern_n;
+	unsigned int core_hash;
+	size_t *trans;
+	int queued;
+};
+struct lr1_state **lr1_states;
+size_t lr1_states_n, lr1_states_cap;
+size_t *lr1_queue, lr1_queue_n;
+
+/*
+ * lr1_core_tab indexes the LR(1) states by their core with
+ * open addressing, as lr0_kern_tab does the LR(0) ones, but
+ * several states can share a core.
+ */
+size_t *lr1_core_tab, lr1_core_tab_cap;
+
+void place_lr1_core(size_t i)
+{
+	size_t mask = lr1_core_tab_cap - 1;
+	size_t h = lr1_states[i]->core_hash & mask;
+	while (lr1_core_tab[h] != 0)
+		h = (h + 1) & mask;
+	lr1_core_tab[h] = i + 1;
+}
+
+/* An item together with its set of lookaheads. */
+struct lr1_item {
+	uint32_t itm;
+	unsigned long *look;
+};
+
+int cmp_lr1_items(const void *a, const void *b)
+{
+	uint32_t x = ((const struct lr1_item *) a)->itm;
+	uint32_t y = ((const struct lr1_item *) b)->itm;
+	return x < y ? -1 : x > y;
+}
+
+unsigned int hash_core(struct lr1_item *kern, size_t kern_n)
+{
+	unsigned int h = 2166136261u;
+	for (size_t k = 0; k < kern_n; k++) {
+		h ^= kern[k].itm;
+		h *= 16777619u;
+	}
+	return h;
+}
+
+/*
+ * Returns 1 if merging the lookaheads of kern into st
+ * cannot create a reduce-reduce conflict that neither
+ * of them has (Pager's weak compatibility):
+ * for every pair of kernel items i, j either
+ * looks_i and kern_j (and kern_i and looks_j) have no
+ * lookahead in common, or the lookaheads of i and j
+ * already meet in st or in kern.
+ */
+int weakly_compatible(struct lr1_state *st, struct lr1_item *kern)
+{
+	for (size_t i = 0; i < st->kern_n; i++) {
+		for (size_t j = i + 1; j < st->kern_n; j++) {
+			if (bitset_intersects(st->looks[i], st->looks[j],
+								TERM_WORDS))
+				continue;
+			if (bitset_intersects(kern[i].look, kern[j].look,
+								TERM_WORDS))
 				continue;
-			enum tk_type tt = citm->dot->sym->term_type;
-			struct itm_list *sto = canon_coll[i]->gt_term_rs[tt];
-			struct action_entry *act = action_tab[i][tt];
-			if (!act->type) {
-				act->type = ACT_SHFT;
-				act->shift_to = get_state_index(sto);
+			if (bitset_intersects(st->looks[i], kern[j].look,
+								TERM_WORDS))
+				return 0;
+			if (bitset_intersects(kern[i].look, st->looks[j],
+								TERM_WORDS))
+				return 0;
+		}
+	}
+	return 1;
+}
+
+void queue_lr1_state(struct lr1_state *st)
+{
+	if (st->queued)
+		return;
+	st->queued = 1;
+	lr1_queue[lr1_queue_n++] = st->idx;
+}
+
+/*
+ * Adds the lookaheads of kern (sorted by cmp_lr1_items) to a
+ * weakly compatible state with the same core, queueing it
+ * again if they were new, or creates a new state for kern.
+ * Returns the index of the state. Does not take ownership
+ * of the lookahead sets in kern.
+ */
+size_t add_lr1_state(struct lr1_item *kern, size_t kern_n)
+{
+	unsigned int h = hash_core(kern, kern_n);
+	size_t mask = lr1_core_tab_cap - 1;
+	struct lr1_state *st;
+	for (size_t t = h & mask; lr1_core_tab[t] != 0; t = (t + 1) & mask) {
+		st = lr1_states[lr1_core_tab[t] - 1];
+		if (st->core_hash != h || st->kern_n != kern_n)
+			continue;
+		size_t k;
+		for (k = 0; k < kern_n; k++)
+			if (st->kern[k] != kern[k].itm)
+				break;
+		if (k < kern_n || !weakly_compatible(st, kern))
+			continue;
+		int grew = 0;
+		for (k = 0; k < kern_n; k++)
+			grew |= bitset_or(st->looks[k], kern[k].look,
+								TERM_WORDS);
+		if (grew)
+			queue_lr1_state(st);
+		return st->idx;
+	}
+
+	if (lr1_states_n == lr1_states_cap) {
+		size_t old = lr1_states_cap;
+		lr1_states_cap = lr1_states_cap ? 2*lr1_states_cap : 64;
+		lr1_states = mem_realloc(lr1_states,
+				old * sizeof(struct lr1_state *),
+				lr1_states_cap * sizeof(struct lr1_state *),
+				MEM_STATE);
+		lr1_queue = mem_realloc(lr1_queue, old * sizeof(size_t),
+				lr1_states_cap * sizeof(size_t), MEM_STATE);
+	}
+	st = mem_alloc(sizeof(struct lr1_state), MEM_STATE);
+	st->idx = lr1_states_n;
+	st->kern_n = kern_n;
+	st->kern = mem_alloc(kern_n * sizeof(uint32_t), MEM_STATE);
+	st->looks = mem_alloc(kern_n * sizeof(unsigned long *), MEM_STATE);
+	for (size_t k = 0; k < kern_n; k++) {
+		st->kern[k] = kern[k].itm;
+		st->looks[k] = make_bitset(TK_TYPE_COUNT);
+		bitset_or(st->looks[k], kern[k].look, TERM_WORDS);
+	}
+	st->core_hash = h;
+	st->trans = mem_alloc((TK_TYPE_COUNT + nts_n) * sizeof(size_t),
+								MEM_STATE);
+	for (size_t x = 0; x < TK_TYPE_COUNT + nts_n; x++)
+		st->trans[x] = NO_STATE;
+	st->queued = 0;
+	lr1_states[lr1_states_n++] = st;
+
+	if (4 * lr1_states_n > 3 * lr1_core_tab_cap) {
+		mem_free(lr1_core_tab, lr1_core_tab_cap * sizeof(size_t),
+								MEM_STATE);
+		lr1_core_tab_cap *= 2;
+		lr1_core_tab = mem_calloc(lr1_core_tab_cap, sizeof(size_t),
+								MEM_STATE);
+		for (size_t k = 0; k < lr1_states_n; k++)
+			place_lr1_core(k);
+	} else {
+		place_lr1_core(st->idx);
+	}
+	queue_lr1_state(st);
+	return st->idx;
+}
+
+/*
+ * Returns the number of items in the LR(0) closure of the
+ * kernel of st and sets *clos to them, sorted, each one with
+ * its lookaheads: [ B -> .z ] gets FIRST(y) for every
+ * [ A -> x.By, L ] in the closure, and also L if y is nullable.
+ */
+size_t lr1_closure(struct lr1_state *st, struct lr1_item **clos)
+{
+	uint32_t *ci;
+	size_t n = lr0_closure(st->kern, st->kern_n, &ci);
+	struct lr1_item *c = mem_alloc(n * sizeof(struct lr1_item),
+								MEM_SCRATCH);
+	for (size_t i = 0, k = 0; i < n; i++) {
+		c[i].itm = ci[i];
+		c[i].look = make_bitset(TK_TYPE_COUNT);
+		/* both ci and the kernel are sorted */
+		if (k < st->kern_n && st->kern[k] == ci[i])
+			bitset_or(c[i].look, st->looks[k++], TERM_WORDS);
+	}
+	free_lr0_closure(ci, st->kern_n);
+
+	int added_to_looks = 1;
+	while (added_to_looks) {
+		added_to_looks = 0;
+		for (size_t i = 0; i < n; i++) {
+			size_t p = ITEM_PROD(c[i].itm), d = ITEM_DOT(c[i].itm);
+			if (d == PROD_LEN(p) ||
+				prod_syms[prod_off[p] + d] < TK_TYPE_COUNT)
 				continue;
+			size_t b = prod_syms[prod_off[p] + d] - TK_TYPE_COUNT;
+			size_t x = ITEM_POS(p, d+1);
+			int nullable = BIT_TEST(nullable_suffixes, x);
+			/* the [ B -> .z ] items of the closure come sorted
+			 * from [ B -> .z1 ] on, among kernel items of the
+			 * same productions.
+			 */
+			size_t lo = 0, hi = n;
+			while (lo < hi) {
+				size_t mid = lo + (hi - lo) / 2;
+				if (c[mid].itm < ITEM(nt_prods[b], 0))
+					lo = mid + 1;
+				else
+					hi = mid;
 			}
-			/* check for shift-reduce conflicts */
-			assert(act->type == ACT_SHFT);
-			assert(act->shift_to == get_state_index(sto));
+			for (size_t t = lo; t < n; t++) {
+				if (ITEM_PROD(c[t].itm) >= nt_prods[b+1])
+					break;
+				if (ITEM_DOT(c[t].itm) != 0)
+					continue;
+				added_to_looks |= bitset_or(c[t].look,
+						suffix_first[x], TERM_WORDS);
+				if (nullable)
+					added_to_looks |= bitset_or(c[t].look,
+						c[i].look, TERM_WORDS);
+			}
+		}
+	}
+
+	*clos = c;
+	return n;
+}
+
+void free_lr1_items(struct lr1_item *c, size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+		free_bitset(c[i].look, TK_TYPE_COUNT);
+	mem_free(c, n * sizeof(struct lr1_item), MEM_SCRATCH);
+}
+
+struct sym_item {
+	size_t sym;
+	struct lr1_item it;
+};
+
+int cmp_sym_items(const void *a, const void *b)
+{
+	const struct sym_item *sa = a, *sb = b;
+	if (sa->sym != sb->sym)
+		return sa->sym < sb->sym ? -1 : 1;
+	return sa->it.itm < sb->it.itm ? -1 : sa->it.itm > sb->it.itm;
+}
+
+/*
+ * Computes the goto of st on every symbol that follows
+ * a dot in its closure and adds it to the collection.
+ */
+void expand_lr1_state(struct lr1_state *st)
+{
+	struct lr1_item *c;
+	size_t n = lr1_closure(st, &c);
+
+	/* advance the dot of every item and group them by symbol */
+	struct sym_item *adv = mem_alloc((n + 1) * sizeof(struct sym_item),
+								MEM_SCRATCH);
+	size_t adv_n = 0;
+	for (size_t i = 0; i < n; i++) {
+		size_t p = ITEM_PROD(c[i].itm), d = ITEM_DOT(c[i].itm);
+		if (d == PROD_LEN(p))
+			continue;
+		adv[adv_n].sym = prod_syms[prod_off[p] + d];
+		adv[adv_n].it.itm = c[i].itm + 1;
+		adv[adv_n].it.look = c[i].look;
+		++adv_n;
+	}
+	qsort(adv, adv_n, sizeof(struct sym_item), cmp_sym_items);
+
+	struct lr1_item *kern = mem_alloc((adv_n + 1) * sizeof(struct lr1_item),
+								MEM_SCRATCH);
+	for (size_t i = 0; i < adv_n;) {
+		size_t sym = adv[i].sym, kern_n = 0;
+		for (; i < adv_n && adv[i].sym == sym; i++)
+			kern[kern_n++] = adv[i].it;
+		st->trans[sym] = add_lr1_state(kern, kern_n);
+	}
+	mem_free(kern, (adv_n + 1) * sizeof(struct lr1_item), MEM_SCRATCH);
+	mem_free(adv, (n + 1) * sizeof(struct sym_item), MEM_SCRATCH);
+	free_lr1_items(c, n);
+}
+
+/*
+ * Builds the LR(1) collection of the grammar merging states
+ * with equal cores whenever they are weakly compatible, as in
+ * Pager's method: the result has the parsing power of
+ * canonical LR(1) and close to as many states as LALR(1).
+ * Only the states reachable from the start state are kept,
+ * and canon_coll, action_tab and goto_tab are filled for them.
+ */
+void compute_lr1_coll()
+{
+	lr1_states = NULL;
+	lr1_queue = NULL;
+	lr1_states_n = lr1_states_cap = lr1_queue_n = 0;
+	lr1_core_tab_cap = 128;
+	lr1_core_tab = mem_calloc(lr1_core_tab_cap, sizeof(size_t), MEM_STATE);
+
+	/* start from [ S' -> .S, $ ] */
+	struct symbol ss = {0, 0, start_sym};
+	size_t start_nt = sym_index(&ss) - TK_TYPE_COUNT;
+	struct lr1_item si;
+	si.itm = ITEM(nt_prods[start_nt], 0);
+	si.look = make_bitset(TK_TYPE_COUNT);
+	BIT_SET(si.look, EOI);
+	add_lr1_state(&si, 1);
+	free_bitset(si.look, TK_TYPE_COUNT);
+
+	while (lr1_queue_n > 0) {
+		struct lr1_state *st = lr1_states[lr1_queue[--lr1_queue_n]];
+		st->queued = 0;
+		expand_lr1_state(st);
+	}
+
+	/* states replaced by merges can become unreachable */
+	size_t *new_idx = mem_alloc(lr1_states_n * sizeof(size_t), MEM_SCRATCH);
+	size_t *order = mem_alloc(lr1_states_n * sizeof(size_t), MEM_SCRATCH);
+	for (size_t i = 0; i < lr1_states_n; i++)
+		new_idx[i] = NO_STATE;
+	canon_coll_n = 0;
+	new_idx[0] = canon_coll_n;
+	order[canon_coll_n++] = 0;
+	for (size_t i = 0; i < canon_coll_n; i++) {
+		struct lr1_state *st = lr1_states[order[i]];
+		for (size_t x = 0; x < TK_TYPE_COUNT + nts_n; x++) {
+			size_t t = st->trans[x];
+			if (t == NO_STATE || new_idx[t] != NO_STATE)
+				continue;
+			new_idx[t] = canon_coll_n;
+			order[canon_coll_n++] = t;
+		}
+	}
+
+	canon_coll = mem_alloc(canon_coll_n * sizeof(struct itm_list *),
+								MEM_TABLE);
+	goto_tab = mem_alloc(canon_coll_n * sizeof(size_t *), MEM_TABLE);
+	alloc_action_tab();
+	for (size_t i = 0; i < canon_coll_n; i++) {
+		struct lr1_state *st = lr1_states[order[i]];
+		struct lr1_item *c;
+		size_t n = lr1_closure(st, &c);
+		canon_coll[i] = NULL;
+		for (size_t k = n; k-- > 0; ) {
+			size_t p = ITEM_PROD(c[k].itm), d = ITEM_DOT(c[k].itm);
+			add_itm_to_list(lr0_itms[ITEM_POS(p, d)],
+							&canon_coll[i]);
 		}
 
-		/* set all remaining entries to error */
+		/* [ S' -> S., $ ] accepts, [ A -> x., L ]
+		 * reduces A -> x on every terminal in L.
+		 */
+		for (size_t k = 0; k < n; k++) {
+			size_t p = ITEM_PROD(c[k].itm);
+			if (ITEM_DOT(c[k].itm) != PROD_LEN(p))
+				continue;
+			if (prod_head[p] == start_nt) {
+				action_tab[i][EOI]->type = ACT_ACC;
+				continue;
+			}
+			struct item *itm = lr0_itms[ITEM_POS(p, 0)];
+			for (size_t tt = bitset_next(c[k].look, TERM_WORDS, 0);
+					tt < TK_TYPE_COUNT;
+					tt = bitset_next(c[k].look, TERM_WORDS, tt+1))
+				add_reduce_action(i, (enum tk_type) tt, itm->head,
+								itm->body);
+		}
 		for (enum tk_type tt = 0; tt < TK_TYPE_COUNT; tt++) {
-			if (!action_tab[i][tt]->type)
-				action_tab[i][tt]->type = ACT_ERR;
+			if (st->trans[tt] == NO_STATE)
+				continue;
+			add_shift_action(i, tt, new_idx[st->trans[tt]]);
 		}
+		fill_action_errs(i);
+
+		goto_tab[i] = mem_alloc(nts_n * sizeof(size_t), MEM_TABLE);
+		for (size_t j = 0; j < nts_n; j++) {
+			size_t t = st->trans[TK_TYPE_COUNT + j];
+			goto_tab[i][j] = t == NO_STATE ? canon_coll_n :
+								new_idx[t];
+		}
+		free_lr1_items(c, n);
 	}
+	mem_free(new_idx, lr1_states_n * sizeof(size_t), MEM_SCRATCH);
+	mem_free(order, lr1_states_n * sizeof(size_t), MEM_SCRATCH);
 }
 
-void parse_bn()
+/* Reads the productions of the BN file into productions. */
+void read_prods()
 {
 	init_grammar();
 	next_token(&tk);
+	parse_prec_decls();
 	skip_tks("<");
 	if (tk.type != TK_ID)
 		panic("expected starting nonterm");
@@ -1058,15 +2765,218 @@ void parse_bn()
 	next_token(&tk);
 	skip_tks(">::=");
 	curr_head = strdup(start_sym);
-	struct prod_head_entry *ne = malloc(sizeof(struct prod_head_entry));
+	struct prod_head_entry *ne = mem_alloc(sizeof(struct prod_head_entry), MEM_ENTRY);
 	INSERT_ENTRY(ne, curr_head, productions);
 	ne->prods = NULL;
 	parse_prods();
+}
+
+/* Augments the grammar and numbers its symbols and productions. */
+void number_grammar()
+{
 	augment_grammar();
 	fill_nts_in_grammar_list();
+	fill_nt_index();
+	fill_prod_tab();
+}
+
+/*
+ * Reads the grammar and numbers its productions,
+ * the front end of parse_bn() without the tables.
+ */
+void read_bn()
+{
+	read_prods();
+	number_grammar();
+}
+
+int mem_report;
+size_t mem_budget;
+
+/*
+ * Reports the memory usage of the phase of parse_bn() that
+ * just ended and checks its peak against mem_budget.
+ */
+void end_phase(const char *phase)
+{
+	if (mem_report)
+		print_mem_stats(phase);
+	if (mem_budget != 0 && mem_total.peak_bytes > mem_budget)
+		panic("%s: peak of %zu bytes over the budget of %zu",
+				phase, mem_total.peak_bytes, mem_budget);
+	reset_mem_peaks();
+}
+
+void parse_bn()
+{
+	reset_mem_peaks();
+	read_bn();
+	end_phase("read");
+	compute_clos_tab();
+	compute_first_tab();
+	compute_follow_tab();
+	end_phase("first/follow");
+	if (tab_kind == TAB_LR1) {
+		compute_lr1_coll();
+		end_phase("lr1 coll");
+	} else {
+		compute_canon_set();
+		compute_canon_coll();
+		end_phase("canon set");
+		compute_action_tab();
+		compute_goto_tab();
+		end_phase("tables");
+	}
+	minimize_states();
+	end_phase("minimize");
+	compute_term_classes();
+	end_phase("classes");
+}
+
+void parse_bn_lazy()
+{
+	reset_mem_peaks();
+	read_bn();
+	end_phase("read");
+	compute_clos_tab();
+	compute_first_tab();
+	compute_follow_tab();
+	end_phase("first/follow");
+	init_lr0_states();
+	action_tab = NULL;
+	lazy_cap = lazy_n = 0;
+	lazy_expand(0);
+}
+
+/*
+ * ll_tab[j][tt] is the production the j-th nonterminal is
+ * expanded by on a lookahead of type tt (prods_n if none):
+ * the one whose body begins with tt, or derives `` while tt
+ * is in the FOLLOW of the nonterminal.
+ */
+size_t **ll_tab;
+
+void fprint_prod(FILE *f, size_t p)
+{
+	struct item *itm = lr0_itms[ITEM_POS(p, 0)];
+	fprintf(f, "%s ->", itm->head);
+	for (struct sym_list *sl = itm->body; sl != NULL; sl = sl->next) {
+		char *sym_repr = repr_sym(sl->sym);
+		fprintf(f, sl->sym->is_term ? " %s" : " <%s>", sym_repr);
+		mem_free(sym_repr, strlen(sym_repr) + 1, MEM_STR);
+	}
+}
+
+void set_ll_entry(size_t j, enum tk_type tt, size_t p)
+{
+	size_t q = ll_tab[j][tt];
+	if (q == prods_n || q == p) {
+		ll_tab[j][tt] = p;
+		return;
+	}
+	++ll_conflicts;
+	struct symbol t = {1, tt, NULL};
+	char *t_repr = repr_sym(&t);
+	fprintf(stderr, "LL(1) conflict on %s between ", t_repr);
+	mem_free(t_repr, strlen(t_repr) + 1, MEM_STR);
+	fprint_prod(stderr, q);
+	fprintf(stderr, " and ");
+	fprint_prod(stderr, p);
+	fputc('\n', stderr);
+}
+
+/* Fills ll_tab, reporting its conflicts to stderr. */
+void compute_ll_tab()
+{
+	ll_tab = mem_alloc(nts_n * sizeof(size_t *), MEM_TABLE);
+	for (size_t j = 0; j < nts_n; j++) {
+		ll_tab[j] = mem_alloc(TK_TYPE_COUNT * sizeof(size_t), MEM_TABLE);
+		for (enum tk_type tt = 0; tt < TK_TYPE_COUNT; tt++)
+			ll_tab[j][tt] = prods_n;
+	}
+	for (size_t p = 0; p < prods_n; p++) {
+		size_t j = prod_head[p], x = ITEM_POS(p, 0), tt;
+		for (tt = bitset_next(suffix_first[x], TERM_WORDS, 0);
+				tt < TK_TYPE_COUNT;
+				tt = bitset_next(suffix_first[x], TERM_WORDS, tt+1))
+			set_ll_entry(j, (enum tk_type) tt, p);
+		if (!BIT_TEST(nullable_suffixes, x))
+			continue;
+		for (tt = bitset_next(follow_sets[j], TERM_WORDS, 0);
+				tt < TK_TYPE_COUNT;
+				tt = bitset_next(follow_sets[j], TERM_WORDS, tt+1))
+			set_ll_entry(j, (enum tk_type) tt, p);
+	}
+}
+
+/*
+ * Reads a grammar like parse_bn(), but removes its left
+ * recursion and left factors it, and builds ll_tab instead
+ * of LR tables.
+ */
+void parse_bn_ll()
+{
+	reset_mem_peaks();
+	ll_conflicts = 0;
+	read_prods();
+	elim_left_rec();
+	left_factor();
+	number_grammar();
+	end_phase("read");
 	compute_first_tab();
 	compute_follow_tab();
-	compute_canon_set();
-	compute_canon_coll();
-	compute_action_tab();
+	end_phase("first/follow");
+	compute_ll_tab();
+	end_phase("ll tab");
+}
+
+/*
+ * Parses the tokens read from in, in the format parser.py
+ * reads, with ll_tab, printing the production of every
+ * expansion (a leftmost derivation) if verbose is set.
+ * Returns 1 if the input is accepted, 0 on a syntax error.
+ */
+int ll_parse(FILE *in, int verbose)
+{
+	size_t cap = 256, n = 0;
+	uint32_t *stack = mem_alloc(cap * sizeof(uint32_t), MEM_SCRATCH);
+	struct symbol ss = {0, 0, start_sym};
+	stack[n++] = (uint32_t) sym_index(&ss);
+	int tt, acc = 1;
+	if (fscanf(in, "%d\t%*[^\n]", &tt) != 1)
+		tt = EOI;
+	while (n > 0) {
+		if (tt < 0 || tt >= TK_TYPE_COUNT)
+			panic("bad token type %d", tt);
+		size_t x = stack[--n];
+		if (x < TK_TYPE_COUNT) {
+			if (x != (size_t) tt) {
+				acc = 0;
+				break;
+			}
+			if (fscanf(in, "%d\t%*[^\n]", &tt) != 1)
+				tt = EOI;
+			continue;
+		}
+		size_t p = ll_tab[x - TK_TYPE_COUNT][tt];
+		if (p == prods_n) {
+			acc = 0;
+			break;
+		}
+		while (n + PROD_LEN(p) > cap) {
+			stack = mem_realloc(stack, cap * sizeof(uint32_t),
+					2 * cap * sizeof(uint32_t), MEM_SCRATCH);
+			cap *= 2;
+		}
+		for (size_t k = prod_off[p+1]; k-- > prod_off[p];)
+			stack[n++] = prod_syms[k];
+		if (verbose) {
+			struct item *itm = lr0_itms[ITEM_POS(p, 0)];
+			printf("%s -> ", itm->head);
+			print_sym_list(itm->body);
+			putchar('\n');
+		}
+	}
+	mem_free(stack, cap * sizeof(uint32_t), MEM_SCRATCH);
+	return acc && tt == EOI;
 }
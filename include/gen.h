@@ -0,0 +1,32 @@
+#ifndef GEN_H
+#define GEN_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Depth bounds of gen_sentence(): above gen_min_depth, productions
+ * without nonterminals are avoided, and from gen_max_depth on,
+ * every nonterminal takes its shortest derivation.
+ */
+extern size_t gen_min_depth, gen_max_depth;
+
+/*
+ * Computes the derivation lengths of the grammar read by read_bn()
+ * and gives every production a weight of 1.
+ */
+void init_gen();
+
+void seed_gen(uint64_t seed);
+
+/* Sets the weight of the k-th production of head (counting from 1). */
+void set_prod_weight(const char *head, size_t k, unsigned int w);
+
+/*
+ * Writes a random sentence of the grammar of about len tokens to
+ * out, one `type\tvalue` line per token, and returns its size in bytes.
+ */
+size_t gen_sentence(size_t len, FILE *out);
+
+#endif
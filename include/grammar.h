@@ -4,6 +4,9 @@
 #include "lexer.h"
 #include "utils.h"
 
+#include <stdint.h>
+#include <stdio.h>
+
 /* XXX: EOI and EMPTY_STR are chosen to be
  * values not present in enum tk_type.
  */
@@ -30,14 +33,63 @@ struct prod_list {
 };
 
 struct prod_head_entry {
-	struct prod_head_entry *next;
 	const char *key;
 	struct prod_list *prods;
 };
-extern struct prod_head_entry *productions[HASHSIZE];
+extern HMAP(prod_head_map, struct prod_head_entry) productions;
+
+/* Kind of table built by parse_bn(): SLR(1) or
+ * LR(1) with Pager's weak-compatibility merging.
+ */
+enum tab_kind {
+	TAB_SLR,	TAB_LR1,
+};
+extern enum tab_kind tab_kind;
+
+/*
+ * With mem_report set, parse_bn() prints the memory usage
+ * of every phase to stderr, and it panics when the peak of
+ * a phase goes over mem_budget bytes (0 for no budget).
+ */
+extern int mem_report;
+extern size_t mem_budget;
+
+/* The productions numbered by read_bn(), see fill_prod_tab(). */
+extern uint32_t *prod_syms;
+extern size_t prods_n, *nt_prods, *prod_off, *prod_head, nts_n;
+extern const char *start_sym;
+
+void read_bn();
 
 void parse_bn();
 
+/* Parses the tokens read from in with the tables of parse_bn(). */
+int lr_parse(FILE *in, int verbose);
+
+/*
+ * parse_bn_lazy() reads a grammar like parse_bn() but builds
+ * no states past the start one: lazy_parse() builds the SLR
+ * row of a state the first time the parse reaches it, and
+ * lazy_n counts the rows built so far.
+ */
+extern size_t lazy_n;
+
+void parse_bn_lazy();
+
+int lazy_parse(FILE *in, int verbose);
+
+/*
+ * parse_bn_ll() removes the left recursion of the grammar,
+ * left factors it and builds its LL(1) table, reporting the
+ * ll_conflicts of the grammar and the table to stderr. ll_parse() parses with
+ * the table as lazy_parse() does with the LR one.
+ */
+extern size_t ll_conflicts;
+
+void parse_bn_ll();
+
+int ll_parse(FILE *in, int verbose);
+
 void print_grammar();
 
 void print_first_tab();
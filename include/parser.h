@@ -3,4 +3,8 @@
 
 void parse();
 
+void parse_lazy();
+
+void parse_ll();
+
 #endif
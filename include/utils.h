@@ -1,10 +1,9 @@
 #ifndef UTILS_H
 #define UTILS_H
 
+#include <limits.h>
 #include <stddef.h>
 
-#define HASHSIZE	101
-
 /*
  * Adds LNK to the start of LIST and
  * sets LIST to point to the new LNK.
@@ -18,57 +17,86 @@ do {				\
 	LIST = LNK;		\
 } while (0)
 
+/*
+ * A string-keyed hash map with open addressing and linear
+ * probing. Every slot caches the hash of its key, so that
+ * probes compare hashes before keys and resizing does not
+ * hash the keys again. The map doubles its capacity before
+ * it gets more than 3/4 full. A zeroed struct hmap is an
+ * empty map.
+ */
+struct hmap_slot {
+	const char *key;
+	void *val;
+	unsigned int hash;
+};
+
+struct hmap {
+	struct hmap_slot *slots;
+	size_t cap;
+	size_t n;
+};
+
+/*
+ * Returns the slot of key in m or m->cap if there is none.
+ * A slot stays the same until the map grows.
+ */
+size_t hmap_find(const struct hmap *m, const char *key);
+
+/* Returns the value for key in m or NULL if there is none. */
+void *hmap_get(const struct hmap *m, const char *key);
+
+/*
+ * Adds val for key to m, which must not have an entry for
+ * key. The key is not copied and must outlive the entry.
+ */
+void hmap_insert(struct hmap *m, const char *key, void *val);
+
+/* Empties m and frees its slots (the keys and values are not freed). */
+void hmap_clear(struct hmap *m);
+
+/*
+ * Declares union NAME, a map whose values are of type TYPE *.
+ * The `type` member is never read or written: it only lets
+ * LOOK_UP and INSERT_ENTRY check the type of their entries
+ * at compile time.
+ */
+#define HMAP(NAME, TYPE)	union NAME { struct hmap m; TYPE *type; }
+
 /*
  * Sets DEST to the entry for KEY in TABLE or
  * NULL if there is no entry for KEY.
- * TABLE should be an array of linked lists
- * of entries which have `next` for their
- * first member and `key` for their second
- * member:
+ * TABLE should be a map declared with HMAP()
+ * whose entries have a `key` member:
  * struct entry {
- * 	struct entry *next;
  * 	const char *key;
  * 	...
- * };)
- * The size of table should be HASHSIZE,
- * which is defined in utils.h.
+ * };
  */
 unsigned int hash(const char *s);
-#define LOOK_UP(DEST, KEY, TABLE)					\
-do {									\
-	for (DEST = TABLE[hash(KEY)]; DEST != NULL; DEST = DEST->next)	\
-		if (strcmp(KEY, DEST->key) == 0)			\
-			break;						\
+#define LOOK_UP(DEST, KEY, TABLE)				\
+do {								\
+	(void) sizeof((DEST) = (TABLE).type);			\
+	DEST = hmap_get(&(TABLE).m, KEY);			\
 } while (0)
 
 /*
- * Sets DEST to a new entry in TABLE for KEY.
- * TABLE must not have an existing
- * entry for the given KEY.
- * TABLE should be an array of linked lists
- * of entries which have `next` for their
- * first member and `key` for their second
- * member:
+ * Adds ENTRY to TABLE for a copy of KEY, which
+ * is stored in ENTRY->key. TABLE must not have
+ * an existing entry for the given KEY.
+ * TABLE should be a map declared with HMAP()
+ * whose entries have a `key` member:
  * struct entry {
- * 	void *next;
  * 	const char *key;
  * 	...
- * };)
- * The size of TABLE should be HASHSIZE,
- * which is defined in utils.h.
+ * };
  */
-#define INSERT_ENTRY(ENTRY, KEY, TABLE)		\
-do {						\
-	void *tmp = ENTRY;			\
-	LOOK_UP(ENTRY, KEY, TABLE);		\
-	assert(ENTRY == NULL);			\
-	ENTRY = tmp;				\
-	ENTRY->key = strdup(KEY);		\
-	assert(ENTRY->key != NULL);		\
-						\
-	unsigned int hash_val = hash(KEY);	\
-	ENTRY->next = TABLE[hash_val];		\
-	TABLE[hash_val] = ENTRY;		\
+#define INSERT_ENTRY(ENTRY, KEY, TABLE)				\
+do {								\
+	(void) sizeof((TABLE).type = (ENTRY));			\
+	ENTRY->key = strdup(KEY);				\
+	assert(ENTRY->key != NULL);				\
+	hmap_insert(&(TABLE).m, ENTRY->key, ENTRY);		\
 } while (0)
 
 /*
@@ -83,6 +111,85 @@ void *reverse_linked_list(void *llist);
 
 char *strdup(const char *s);
 
+/*
+ * Bitsets are arrays of unsigned long words,
+ * BITSET_WORDS(N) of them hold N bits.
+ */
+#define WORD_BITS	(sizeof(unsigned long) * CHAR_BIT)
+#define BITSET_WORDS(N)	(((N) + WORD_BITS - 1) / WORD_BITS)
+#define BIT_SET(BS, I)	((BS)[(I) / WORD_BITS] |= 1UL << ((I) % WORD_BITS))
+#define BIT_TEST(BS, I)	(((BS)[(I) / WORD_BITS] >> ((I) % WORD_BITS)) & 1UL)
+
+/* Returns a new bitset of nbits bits, all of them cleared. */
+unsigned long *make_bitset(size_t nbits);
+
+/*
+ * bitset_or() and bitset_count() dispatch to AVX2, SSE2
+ * or POPCNT kernels when the CPU has them, and to the
+ * scalar ones otherwise.
+ */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BITSET_SIMD
+#include <immintrin.h>
+#endif
+
+/*
+ * Sets dst to dst | src and returns 1
+ * if that added any bit to dst.
+ */
+int bitset_or(unsigned long *dst, const unsigned long *src, size_t words);
+int bitset_or_scalar(unsigned long *dst, const unsigned long *src,
+							size_t words);
+
+/* Returns the number of bits set in bs. */
+size_t bitset_count(const unsigned long *bs, size_t words);
+size_t bitset_count_scalar(const unsigned long *bs, size_t words);
+
+/*
+ * Returns the first bit set in bs from i on,
+ * or words * WORD_BITS if there is none.
+ */
+size_t bitset_next(const unsigned long *bs, size_t words, size_t i);
+
+/* Returns 1 if a and b have a bit in common. */
+int bitset_intersects(const unsigned long *a, const unsigned long *b,
+							size_t words);
+
 char *extended_str(const char *base, const char *ext);
 
+/*
+ * Counting allocator. Every allocation is tagged with the
+ * structure it holds, and its size is given again to free
+ * it, so that mem_stats[tag] keeps the live bytes and count
+ * of the tag and their peaks since the last reset_mem_peaks().
+ * mem_total keeps the same over all the tags.
+ */
+enum mem_tag {
+	MEM_SYMBOL,	MEM_SYM_LIST,	MEM_PROD,
+	MEM_ITEM,	MEM_ITM_LIST,	MEM_STATE,
+	MEM_HMAP,	MEM_ENTRY,	MEM_ACTION,
+	MEM_STR,	MEM_BITSET,	MEM_TABLE,
+	MEM_SCRATCH,
+	MEM_TAG_COUNT,
+};
+
+struct mem_stat {
+	size_t bytes, peak_bytes;
+	size_t n, peak_n;
+};
+extern struct mem_stat mem_stats[MEM_TAG_COUNT], mem_total;
+
+void *mem_alloc(size_t size, enum mem_tag tag);
+void *mem_calloc(size_t n, size_t size, enum mem_tag tag);
+/* old_size is the size p was allocated with (0 if p is NULL). */
+void *mem_realloc(void *p, size_t old_size, size_t size, enum mem_tag tag);
+void mem_free(void *p, size_t size, enum mem_tag tag);
+
+void free_bitset(unsigned long *bs, size_t nbits);
+
+/* Prints mem_stats to stderr under the name of a phase. */
+void print_mem_stats(const char *phase);
+
+void reset_mem_peaks();
+
 #endif
@@ -0,0 +1,489 @@
+"""
+LR driver shared by parser.py and arith_parser.py.
+
+Tables flattens the tables pickled by make_tab.py into lists
+indexed by state, terminal class, nonterminal and production,
+and parse() runs the shift/reduce loop over them: in C when
+the _lrdriver extension is built (make pyext), in Python
+otherwise. parse_chunked() does the same over several
+processes. profile() counts the states a corpus goes through,
+for make_tab.py to number them by.
+"""
+from array import array
+import collections
+import itertools
+import multiprocessing
+import os
+
+from make_tab import SHIFT, ACCEPT, ERROR, SHIFT_REDUCE, EOI, EMPTY_STR
+
+# An encoded action is its kind plus its argument (the state to
+# shift to or the production to reduce by) shifted KIND_BITS left.
+# NO_ACT entries fall back to the default action of the state.
+# ACT_SHIFT_REDUCE shifts and reduces by its production at once,
+# without pushing the state shifted to.
+NO_ACT, ACT_SHIFT, ACT_REDUCE, ACT_ACCEPT, ACT_ERROR, ACT_SHIFT_REDUCE = (
+    range(6)
+)
+KIND_BITS = 3
+KIND_MASK = (1 << KIND_BITS) - 1
+SYNTAX_ERR = "Can not handle token"
+
+try:
+    import _lrdriver
+except ImportError:
+    _lrdriver = None
+
+
+class Tables:
+    def __init__(
+        self, start_state, action_tab, term_class, goto_tab,
+        state_to_sym, default_tab, lr0_red_states,
+    ):
+        self.start_state = start_state
+        self.prods: list[tuple] = list()
+        prod_ids: dict[tuple, int] = dict()
+        nts: dict[str, int] = dict()
+        states_n = 1 + max(
+            [start_state] + list(state_to_sym) + list(default_tab)
+            + [i for i, _ in action_tab] + [i for i, _ in goto_tab]
+        )
+
+        def encode(act):
+            if act[0] == SHIFT:
+                return ACT_SHIFT | act[1] << KIND_BITS
+            if act[0] == ACCEPT:
+                return ACT_ACCEPT
+            if act[0] == ERROR:
+                return ACT_ERROR
+            kind, red = ACT_REDUCE, act[1]
+            if act[0] == SHIFT_REDUCE:
+                kind, red = ACT_SHIFT_REDUCE, act[2]
+            if red not in prod_ids:
+                prod_ids[red] = len(self.prods)
+                self.prods.append(red)
+                nts.setdefault(red[0], len(nts))
+            return kind | prod_ids[red] << KIND_BITS
+
+        self.classes_n = 1 + max(term_class.values(), default=0)
+        self.acts = [NO_ACT] * (states_n * self.classes_n)
+        for (i, c), act in action_tab.items():
+            self.acts[i * self.classes_n + c] = encode(act)
+        self.dflts = [NO_ACT] * states_n
+        for i, act in default_tab.items():
+            self.dflts[i] = encode(act)
+        self.lr0_red = [i in lr0_red_states for i in range(states_n)]
+
+        for (_, sym) in goto_tab:
+            if type(sym) == str:
+                nts.setdefault(sym, len(nts))
+        self.nts_n = len(nts)
+        self.gotos = [-1] * (states_n * self.nts_n)
+        for (i, sym), j in goto_tab.items():
+            if type(sym) == str and j != ERROR:
+                self.gotos[i * self.nts_n + nts[sym]] = j
+
+        self.class_map = [-1] * (1 + max(term_class, default=0))
+        for t, c in term_class.items():
+            self.class_map[t] = c
+        self.prod_len = [
+            len([s for s in body if s != EMPTY_STR]) for _, body in self.prods
+        ]
+        self.prod_head = [nts[head] for head, _ in self.prods]
+
+        self.c_tabs = None
+        if _lrdriver:
+            self.c_tabs = _lrdriver.load(
+                self.acts, self.dflts, self.lr0_red, self.gotos,
+                self.class_map, self.prod_len, self.prod_head,
+                self.classes_n, self.nts_n,
+            )
+
+
+def prod_actions(tabs, actions):
+    # the actions as a list indexed by production
+    acts = [None] * len(tabs.prods)
+    for prod, f in (actions or dict()).items():
+        if prod in tabs.prods:
+            acts[tabs.prods.index(prod)] = f
+    return acts
+
+
+def parse(tabs, tokens, actions=None):
+    """
+    Parses the (type, value) pairs of tokens and returns the
+    value of the start symbol. actions maps a production
+    (head, body) to a function called with the values of the
+    body on every reduction by it, its result being the value
+    of the head. Reductions without one take the value of the
+    first symbol of the body (None for empty bodies), so only
+    the productions in actions call back into Python.
+    """
+    acts = prod_actions(tabs, actions)
+    if tabs.c_tabs is not None:
+        return _lrdriver.parse(tabs.c_tabs, tabs.start_state, tokens, acts)
+    return py_parse(tabs, tokens, acts)
+
+
+def parse_batch(tabs, streams, actions=None, lanes=1):
+    """
+    Parses every stream of (type, value) pairs in streams and
+    returns the list of their results: the value of the start
+    symbol, or the exception raised for a syntax error. The
+    extension advances lanes parsers in lockstep, reusing
+    their stacks from one stream to the next. Interleaving
+    only pays off once the tables no longer fit in cache.
+    """
+    acts = prod_actions(tabs, actions)
+    if tabs.c_tabs is not None:
+        return _lrdriver.parse_batch(
+            tabs.c_tabs, tabs.start_state, streams, acts, lanes
+        )
+    results = list()
+    for tokens in streams:
+        try:
+            results.append(py_parse(tabs, tokens, acts))
+        except Exception as e:
+            # errors raised by the actions are not results
+            if e.args[:1] != (SYNTAX_ERR, ):
+                raise
+            results.append(e)
+    return results
+
+
+def py_parse(tabs, tokens, acts):
+    tokens = iter(tokens)
+    states = [tabs.start_state]
+    vals = [None]
+    have_tk = False
+    tk_type, tk_val = EOI, ""
+    classes_n, nts_n, class_map = tabs.classes_n, tabs.nts_n, tabs.class_map
+
+    while True:
+        s = states[-1]
+        # LR(0) reduce states do not need the lookahead,
+        # so the next token is only read when it is needed.
+        if tabs.lr0_red[s]:
+            act = tabs.dflts[s]
+        else:
+            if not have_tk:
+                tk_type, tk_val = next(tokens, (EOI, ""))
+                have_tk = True
+            c = class_map[tk_type] if 0 <= tk_type < len(class_map) else -1
+            act = tabs.acts[s * classes_n + c] if c >= 0 else NO_ACT
+            if act == NO_ACT:
+                act = tabs.dflts[s]
+        kind, arg = act & KIND_MASK, act >> KIND_BITS
+        if kind == ACT_SHIFT_REDUCE:
+            # the state shifted to is never looked at
+            states.append(s)
+            vals.append(tk_val)
+            have_tk = False
+            kind = ACT_REDUCE
+        if kind == ACT_SHIFT:
+            states.append(arg)
+            vals.append(tk_val)
+            have_tk = False
+        elif kind == ACT_REDUCE:
+            n = tabs.prod_len[arg]
+            if acts[arg]:
+                val = acts[arg](*vals[len(vals) - n:])
+            else:
+                val = vals[-n] if n else None
+            if n:
+                del states[-n:]
+                del vals[-n:]
+            states.append(tabs.gotos[states[-1] * nts_n + tabs.prod_head[arg]])
+            vals.append(val)
+        elif kind == ACT_ACCEPT:
+            return vals[-1]
+        else:
+            raise Exception(SYNTAX_ERR, tk_type)
+
+
+def trace(tabs, states, types, final):
+    """
+    Runs the parser from the stack of states over the token
+    types and returns the events, -1 for a shift and the
+    production for a reduction, as an array of longs, and the
+    stack once it needs a token past the last one. With final
+    set the input ends there, and the run stops at the accept
+    instead. Returns None on a syntax error.
+    """
+    events = array("l")
+    if tabs.c_tabs is not None:
+        run = _lrdriver.trace(tabs.c_tabs, states, types, final)
+        if run is None:
+            return None
+        events.frombytes(run[0])
+        return events, run[1]
+    states = list(states)
+    k = 0
+    while True:
+        s = states[-1]
+        if tabs.lr0_red[s]:
+            act = tabs.dflts[s]
+        elif k < len(types) or final:
+            t = types[k] if k < len(types) else EOI
+            c = tabs.class_map[t] if 0 <= t < len(tabs.class_map) else -1
+            act = tabs.acts[s * tabs.classes_n + c] if c >= 0 else NO_ACT
+            if act == NO_ACT:
+                act = tabs.dflts[s]
+        else:
+            return events, states
+        kind, arg = act & KIND_MASK, act >> KIND_BITS
+        if kind == ACT_SHIFT_REDUCE:
+            states.append(s)
+            events.append(-1)
+            k += 1
+            kind = ACT_REDUCE
+        if kind == ACT_SHIFT:
+            states.append(arg)
+            events.append(-1)
+            k += 1
+        elif kind == ACT_REDUCE:
+            if tabs.prod_len[arg]:
+                del states[-tabs.prod_len[arg]:]
+            states.append(
+                tabs.gotos[states[-1] * tabs.nts_n + tabs.prod_head[arg]]
+            )
+            events.append(arg)
+        elif kind == ACT_ACCEPT:
+            return events, states
+        else:
+            return None
+
+
+def profile(tabs, types, hits, trans):
+    """
+    Runs the parser over the token types as trace() does and
+    adds to hits[s] the times it enters state s, and to
+    trans[s, t] the shifts and gotos from s to t, up to the
+    accept or the syntax error.
+    """
+    states = [tabs.start_state]
+    hits[tabs.start_state] = hits.get(tabs.start_state, 0) + 1
+    k = 0
+    while True:
+        s = states[-1]
+        if tabs.lr0_red[s]:
+            act = tabs.dflts[s]
+        else:
+            t = types[k] if k < len(types) else EOI
+            c = tabs.class_map[t] if 0 <= t < len(tabs.class_map) else -1
+            act = tabs.acts[s * tabs.classes_n + c] if c >= 0 else NO_ACT
+            if act == NO_ACT:
+                act = tabs.dflts[s]
+        kind, arg = act & KIND_MASK, act >> KIND_BITS
+        if kind == ACT_SHIFT_REDUCE:
+            states.append(s)
+            k += 1
+            kind = ACT_REDUCE
+        if kind == ACT_SHIFT:
+            k += 1
+        elif kind == ACT_REDUCE:
+            if tabs.prod_len[arg]:
+                del states[-tabs.prod_len[arg]:]
+            arg = tabs.gotos[states[-1] * tabs.nts_n + tabs.prod_head[arg]]
+        else:
+            return
+        hits[arg] = hits.get(arg, 0) + 1
+        trans[states[-1], arg] = trans.get((states[-1], arg), 0) + 1
+        states.append(arg)
+
+
+def write_profile(path, hits, trans):
+    # a line "s STATE HITS" per state and "t FROM TO HITS"
+    # per transition, read by make_tab.py --profile
+    with open(path, "w") as f:
+        for s, n in sorted(hits.items()):
+            f.write(f"s {s} {n}\n")
+        for (s, t), n in sorted(trans.items()):
+            f.write(f"t {s} {t} {n}\n")
+
+
+class Pending:
+    """
+    A value of a chunk of parse_chunked() that depends on the
+    stack below the chunk: the i-th value of that stack from
+    the top for i < 0, else the result of the i-th deferred
+    reduction of the chunk.
+    """
+    __slots__ = ("i", )
+
+    def __init__(self, i):
+        self.i = i
+
+
+def run_chunk_from(tabs, acts, tokens, states, final):
+    """
+    Parses tokens from the stack of states as trace() does and
+    runs the actions of the reductions that stay above that
+    stack. Returns the depth low the stack went down to, the
+    states and values above it, and the (production, values)
+    of the reductions whose values are Pending, in order.
+    Returns None on a syntax error.
+    """
+    run = trace(tabs, states, [t for t, _ in tokens], final)
+    if run is None:
+        return None
+    events, end = run
+    vals = [Pending(k - len(states)) for k in range(len(states))]
+    low = len(vals)
+    deferred = list()
+    k = 0
+    for e in events:
+        if e < 0:
+            vals.append(tokens[k][1])
+            k += 1
+            continue
+        n = tabs.prod_len[e]
+        args = vals[len(vals) - n:]
+        if n:
+            del vals[-n:]
+        low = min(low, len(vals))
+        if not acts[e]:
+            val = args[0] if n else None
+        elif any(type(a) is Pending for a in args):
+            deferred.append((e, args))
+            val = Pending(len(deferred) - 1)
+        else:
+            val = acts[e](*args)
+        vals.append(val)
+    return low, end[low:], vals[low:], deferred
+
+
+def error_token(tabs, states, types):
+    # the type of the token parse() raises its syntax error at,
+    # parsing types from states: the first token whose prefix
+    # fails, or EOI if every prefix parses
+    if trace(tabs, states, types, False) is not None:
+        return EOI
+    lo, hi = 0, len(types) - 1
+    while lo < hi:
+        mid = (lo + hi) // 2
+        if trace(tabs, states, types[:mid + 1], False) is None:
+            hi = mid
+        else:
+            lo = mid + 1
+    return types[lo]
+
+
+# The tables and actions of parse_chunked(),
+# inherited by its forked workers.
+chunk_job = None
+
+def run_chunk(chunk):
+    tokens, states, final = chunk
+    tabs, acts = chunk_job
+    try:
+        return run_chunk_from(tabs, acts, tokens, states, final)
+    except Exception:
+        # the actions may fail on a wrong guess: the chunk is
+        # run again from the right stack, raising for real
+        return None
+
+
+def split_chunks(tokens, sync, chunk_len):
+    # the lists of at least chunk_len tokens of the token
+    # iterator, each ending with a sync token but the last
+    chunk = list()
+    for tk in tokens:
+        chunk.append(tk)
+        if len(chunk) >= chunk_len and tk[0] in sync:
+            yield chunk
+            chunk = list()
+    yield chunk
+
+
+def parse_chunked(tabs, tokens, sync, jobs=None, actions=None,
+                  chunk_len=1 << 14):
+    """
+    Like parse(), but parsing chunks of tokens in jobs processes.
+    The chunks are read from tokens as they come, and every one
+    but the last ends with a token whose type is in sync. All
+    but the first are parsed from the stack that the first sync
+    token leaves, in the guess that every split falls at the
+    same depth (between two statements of a list, say).
+
+    Each worker runs the actions of its chunk, but those of the
+    reductions that reach below the chunk, which are run as the
+    chunks are merged in order. Only the top of the stack of a
+    chunk, above the depth it went down to, goes back to the
+    parent. A chunk whose guess differs from the stack left by
+    the chunk before it, or that fails, is parsed again from
+    that stack, so the value is always the one of parse(). The
+    actions must not depend on the order they are called in.
+    """
+    global chunk_job
+
+    tokens = iter(tokens)
+    jobs = jobs or os.cpu_count() or 1
+    acts = prod_actions(tabs, actions)
+
+    head = list()
+    for tk in tokens:
+        head.append(tk)
+        if tk[0] in sync:
+            break
+    else:
+        return parse(tabs, head, actions)
+    guess = trace(tabs, [tabs.start_state], [t for t, _ in head], False)
+    guess = guess[1] if guess else [tabs.start_state]
+
+    states, vals = [tabs.start_state], [None]
+
+    def merge(chunk, run):
+        tokens, guess, final = chunk
+        if run is None or guess != states:
+            run = run_chunk_from(tabs, acts, tokens, states, final)
+        if run is None:
+            types = [t for t, _ in tokens]
+            raise Exception(SYNTAX_ERR, error_token(tabs, states, types))
+        low, top_states, top_vals, deferred = run
+        results = list()
+
+        def resolve(v):
+            if type(v) is not Pending:
+                return v
+            return vals[v.i] if v.i < 0 else results[v.i]
+
+        for e, args in deferred:
+            results.append(acts[e](*[resolve(a) for a in args]))
+        top_vals = [resolve(v) for v in top_vals]
+        del states[low:], vals[low:]
+        states.extend(top_states)
+        vals.extend(top_vals)
+
+    def chunks():
+        prev = None
+        for chunk in split_chunks(itertools.chain(head, tokens), sync,
+                                  chunk_len):
+            if prev is not None:
+                yield prev, False
+            prev = chunk
+        yield prev, True
+
+    chunk_job = (tabs, acts)
+    try:
+        if "fork" not in multiprocessing.get_all_start_methods():
+            for k, (chunk, final) in enumerate(chunks()):
+                start = [tabs.start_state] if k == 0 else guess
+                merge((chunk, start, final), None)
+            return vals[-1]
+        with multiprocessing.get_context("fork").Pool(jobs) as pool:
+            # at most 2 * jobs chunks are read ahead of the merge
+            pending = collections.deque()
+            for k, (chunk, final) in enumerate(chunks()):
+                start = [tabs.start_state] if k == 0 else guess
+                job = (chunk, start, final)
+                pending.append((job, pool.apply_async(run_chunk, (job, ))))
+                if len(pending) > 2 * jobs:
+                    job, res = pending.popleft()
+                    merge(job, res.get())
+            while pending:
+                job, res = pending.popleft()
+                merge(job, res.get())
+        return vals[-1]
+    finally:
+        chunk_job = None
@@ -0,0 +1,222 @@
+"""
+Table server: keeps the tables of every grammar it is sent,
+keyed by the hash of the grammar, and parses inputs with them,
+so that clients skip process startup and table construction.
+
+Requests and responses are frames: a header line of words,
+the last one being the length of the body, and the body.
+    grammar N       body: the tokens of a BN file, as the lines
+                    make_tab.py reads. Builds its tables unless
+                    they are cached. Response body: the hash.
+    parse HASH N    body: the tokens of an input, as the lines
+                    parser.py reads. Response body: empty.
+    reductions HASH N
+                    as parse, the response body being the
+                    reductions, one per line as parser.py
+                    prints them.
+Responses are "ok N" or "err N", the body of the latter being
+the error. The server reads frames from stdin and writes the
+responses to stdout, or listens on a Unix domain socket and
+serves every connection on a pool of threads that share the
+tables (which are never written once built).
+"""
+from concurrent.futures import ThreadPoolExecutor
+import hashlib
+import os
+import pickle
+import socket
+import subprocess
+import sys
+import tempfile
+import threading
+
+from make_tab import repr_sym
+from lrdriver import SYNTAX_ERR, Tables, error_token, parse, trace
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+
+
+def build_tables(bn_tokens, jobs=None):
+    """
+    Runs make_tab.py over bn_tokens, the lines of the tokens
+    of a BN file, and returns its tables.
+    """
+    argv = [sys.executable, os.path.join(HERE, "make_tab.py")]
+    if jobs:
+        argv.append(f"-j{jobs}")
+    with tempfile.TemporaryDirectory() as d:
+        run = subprocess.run(
+            argv, input=bn_tokens, text=True, cwd=d,
+            stdout=subprocess.DEVNULL, stderr=subprocess.PIPE,
+        )
+        if run.returncode != 0:
+            err = run.stderr.strip().splitlines()
+            raise Exception(err[-1] if err else "make_tab.py failed")
+        with open(os.path.join(d, "lalr-tab"), "rb") as f:
+            return Tables(*pickle.load(f))
+
+
+def read_frame(f):
+    # the words of the header and the body, None at the end of f
+    header = f.readline()
+    if not header:
+        return None
+    words = header.decode().split()
+    if not words:
+        raise Exception("empty header")
+    n = int(words.pop())
+    body = f.read(n)
+    if len(body) < n:
+        raise Exception("truncated frame")
+    return words, body
+
+def write_frame(f, words, body=b""):
+    f.write(f"{' '.join(words)} {len(body)}\n".encode() + body)
+    f.flush()
+
+def read_tokens(body):
+    tokens = list()
+    for tk in body.decode().splitlines():
+        t, v = tk.split('\t', 1)
+        tokens.append((int(t), v.rstrip()))
+    return tokens
+
+
+class TableServer:
+    def __init__(self, jobs=None):
+        self.jobs = jobs
+        self.tables: dict[str, Tables] = dict()
+        # build_locks[key] is taken to build the tables of key, so
+        # that a grammar sent by several clients is built once while
+        # other grammars are built alongside; locks_lock guards it
+        self.build_locks: dict[str, threading.Lock] = dict()
+        self.locks_lock = threading.Lock()
+
+    def load(self, bn_tokens):
+        key = hashlib.sha256(bn_tokens.encode()).hexdigest()
+        if key in self.tables:
+            return key
+        with self.locks_lock:
+            lock = self.build_locks.setdefault(key, threading.Lock())
+        with lock:
+            if key not in self.tables:
+                self.tables[key] = build_tables(bn_tokens, self.jobs)
+        with self.locks_lock:
+            self.build_locks.pop(key, None)
+        return key
+
+    def reductions(self, tabs, tokens):
+        types = [t for t, _ in tokens]
+        run = trace(tabs, [tabs.start_state], types, True)
+        if run is None:
+            # the error parse() raises, at the token that caused it
+            raise Exception(
+                SYNTAX_ERR, error_token(tabs, [tabs.start_state], types)
+            )
+        lines = list()
+        for e in run[0]:
+            if e >= 0:
+                head, body = tabs.prods[e]
+                lines.append(f"{head} -> {[repr_sym(s) for s in body]}\n")
+        return "".join(lines)
+
+    def handle(self, words, body):
+        # the response to a request, as (words, body)
+        cmd, args = words[0], words[1:]
+        if cmd == "grammar" and not args:
+            return ["ok"], self.load(body.decode()).encode()
+        if cmd in ("parse", "reductions") and len(args) == 1:
+            tabs = self.tables.get(args[0])
+            if tabs is None:
+                return ["err"], f"unknown grammar {args[0]}".encode()
+            tokens = read_tokens(body)
+            if cmd == "parse":
+                parse(tabs, tokens)
+                return ["ok"], b""
+            return ["ok"], self.reductions(tabs, tokens).encode()
+        return ["err"], f"bad request {' '.join(words)}".encode()
+
+    def serve(self, rf, wf):
+        # answers the requests read from rf until its end
+        while True:
+            try:
+                req = read_frame(rf)
+                if req is None:
+                    return
+                res = self.handle(*req)
+            except Exception as e:
+                res = ["err"], " ".join(str(a) for a in e.args).encode()
+            write_frame(wf, *res)
+
+    def serve_socket(self, path, threads):
+        sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        sock.bind(path)
+        sock.listen()
+        with sock, ThreadPoolExecutor(threads) as pool:
+            while True:
+                conn, _ = sock.accept()
+                pool.submit(self.serve_conn, conn)
+
+    def serve_conn(self, conn):
+        with conn, conn.makefile("rb") as rf, conn.makefile("wb") as wf:
+            self.serve(rf, wf)
+
+
+class Client:
+    """Sends requests to a TableServer listening on a socket."""
+    def __init__(self, path):
+        self.sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        self.sock.connect(path)
+        self.rf = self.sock.makefile("rb")
+        self.wf = self.sock.makefile("wb")
+
+    def request(self, words, body=b""):
+        write_frame(self.wf, words, body)
+        res = read_frame(self.rf)
+        if res is None:
+            raise Exception("connection closed")
+        if res[0] != ["ok"]:
+            raise Exception(res[1].decode())
+        return res[1]
+
+    def grammar(self, bn_tokens):
+        return self.request(["grammar"], bn_tokens.encode()).decode()
+
+    def parse(self, key, tokens):
+        self.request(["parse", key], tokens.encode())
+
+    def reductions(self, key, tokens):
+        return self.request(["reductions", key], tokens.encode()).decode()
+
+    def close(self):
+        self.rf.close()
+        self.wf.close()
+        self.sock.close()
+
+
+if __name__ == "__main__":
+    import argparse
+
+    argp = argparse.ArgumentParser(
+        description="parse inputs with the cached tables of the grammars sent"
+    )
+    argp.add_argument(
+        "-s", "--socket", metavar="PATH",
+        help="listen on a Unix domain socket instead of stdin",
+    )
+    argp.add_argument(
+        "-t", "--threads", type=int, default=os.cpu_count() or 1,
+        metavar="N", help="threads serving the connections (default: all CPUs)",
+    )
+    argp.add_argument(
+        "-j", "--jobs", type=int, default=None, metavar="N",
+        help="processes make_tab.py determines the lookaheads with "
+        "(default: 1)",
+    )
+    args = argp.parse_args()
+
+    server = TableServer(args.jobs)
+    if args.socket:
+        server.serve_socket(args.socket, args.threads)
+    else:
+        server.serve(sys.stdin.buffer, sys.stdout.buffer)
@@ -1,8 +1,50 @@
+#include "grammar.h"
 #include "lexer.h"
 #include "parser.h"
 
+#include <stdlib.h>
+#include <string.h>
+
 int main(int argc, char **argv)
 {
+	/* -lr1: build LR(1) tables instead of SLR ones
+	 * -mem: report the memory usage of every phase
+	 * -mem-budget N: fail if a phase peaks over N bytes
+	 * -lazy: build the SLR states the tokens read from stdin
+	 *	reach as they are parsed, printing the reductions
+	 * -ll: parse the tokens read from stdin with an LL(1) table
+	 *	of the grammar, printing the expansions
+	 */
+	int lazy = 0, ll = 0;
+	for (; argc > 1 && argv[1][0] == '-'; --argc, ++argv) {
+		if (strcmp(argv[1], "-lr1") == 0) {
+			tab_kind = TAB_LR1;
+		} else if (strcmp(argv[1], "-lazy") == 0) {
+			lazy = 1;
+		} else if (strcmp(argv[1], "-ll") == 0) {
+			ll = 1;
+		} else if (strcmp(argv[1], "-mem") == 0) {
+			mem_report = 1;
+		} else if (strcmp(argv[1], "-mem-budget") == 0 && argc > 2) {
+			mem_budget = strtoull(argv[2], NULL, 10);
+			--argc;
+			++argv;
+		} else {
+			panic("unknown option %s", argv[1]);
+		}
+	}
+	if (lazy || ll) {
+		if (argc != 2)
+			panic("-lazy and -ll take one grammar, the tokens being stdin");
+		if (lazy && (ll || tab_kind == TAB_LR1))
+			panic("-lazy builds SLR tables only");
+		init_lexer(argv[1]);
+		if (ll)
+			parse_ll();
+		else
+			parse_lazy();
+		return 0;
+	}
 	if (argc == 1) {
 		init_lexer(NULL);
 		parse();
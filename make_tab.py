@@ -1,3 +1,4 @@
+import multiprocessing
 import sys
 from typing import Union
 from collections import namedtuple
@@ -9,9 +10,14 @@ EOI = ord('$')
 EMPTY_STR = ord('@')
 NG = ord('`') # a symbol not present in the grammar
 
+LEFT = "left"
+RIGHT = "right"
+NONASSOC = "nonassoc"
+
 SHIFT = 0
 REDUCE = 1
 ACCEPT = 2
+SHIFT_REDUCE = 3
 ERROR = -3
 if ERROR >= 0:
     raise Exception("ERROR should be set to a negative value")
@@ -21,6 +27,7 @@ LR0Item = namedtuple("Item", ["head", "body", "dot"])
 Item = namedtuple("Item", ["head", "body", "dot", "look"])
 
 productions: dict[str, list[tuple]] = dict()
+prec_tab: dict[int, tuple[int, str]] = dict()
 terms: list[int] = list()
 nonterms: list[str] = list()
 start_sym: str = ""
@@ -30,6 +37,7 @@ curr_head: str = ""
 curr_prod: list = list()
 first_tab: dict[Union[int, str], list[int]] = dict()
 follow_tab: dict[str, list[int]] = dict()
+suffix_first: dict[tuple, list[tuple[tuple, bool]]] = dict()
 canon: list[list[LR0Item]] = list()
 canon_kerns: list[list[LR0Item]] = list()
 look_tab: dict[tuple[int, int], list[int]] = dict()
@@ -38,6 +46,13 @@ lalr_set_n: int = 0
 state_to_sym: dict[int, Union[int, str]] = dict()
 goto_tab: dict[tuple[int, Union[int, str]], int] = dict()
 action_tab = dict()
+default_tab: dict[int, tuple] = dict()
+lr0_red_states: set[int] = set()
+nonassoc_errs: set[tuple[int, int]] = set()
+term_class: dict[int, int] = dict()
+class_action_tab: dict[tuple[int, int], tuple] = dict()
+tab_n = 0
+unit_merges: dict[tuple, int] = dict()
 canon_n = 0
 start_lr0_item = None
 start_state = 0
@@ -163,7 +178,7 @@ def print_sym_states():
 
 def print_goto_tab():
     print("GOTO")
-    for i in range(canon_n):
+    for i in range(tab_n):
         print("\t", i)
         for nt in nonterms:
             if nt == start_sym:
@@ -172,13 +187,16 @@ def print_goto_tab():
 
 def print_action_tab():
     print("ACTION")
-    for i in range(canon_n):
-        print("\t", i)
+    for i in range(tab_n):
+        print("\t", i, "(LR0 reduce)" if i in lr0_red_states else "")
         for t in terms:
             print("\t\t", repr_sym(t), end="\t")
-            act = action_tab[i, t]
+            act = get_action(i, t)
             if act[0] == SHIFT:
                 print("S\t", act[1])
+            elif act[0] == SHIFT_REDUCE:
+                print("SR\t", act[1], act[2][0], "->",
+                        [repr_sym(s) for s in act[2][1]])
             elif act[0] == REDUCE:
                 print("R\t", act[1][0], "->", [repr_sym(s) for s in act[1][1]])
             elif act[0] == ACCEPT:
@@ -188,6 +206,11 @@ def print_action_tab():
             else:
                 raise Exception("invalid action found in action_tab")
 
+def get_action(i, t):
+    # entries dropped by compute_default_reds() fall
+    # back to the default reduction of the state
+    return action_tab.get((i, t), default_tab.get(i, (ERROR, )))
+
 def expected(exp):
     raise Exception(
         f"on token {tk_n} \"{chr(tk.type)}\": "
@@ -273,6 +296,26 @@ def parse_prods():
         if not more_input:
             add_prod()
 
+def parse_prec_decls():
+    # %left `+` `-`
+    # %left `*` `/`
+    # every declaration binds tighter than the previous ones
+    level = 0
+    while tk.type == ord('%'):
+        next_token()
+        if tk.type != TK_ID or tk.str_val not in (LEFT, RIGHT, NONASSOC):
+            expected("left, right or nonassoc")
+        assoc = tk.str_val
+        level += 1
+        next_token()
+        if tk.type != ord('`'):
+            expected("`")
+        while tk.type == ord('`'):
+            next_token()
+            prec_tab[tk.type] = (level, assoc)
+            next_token()
+            skip_tks("`")
+
 def augment_grammar():
     global curr_prod, curr_head, start_sym
     curr_head = start_sym + "_s"
@@ -335,6 +378,28 @@ def compute_first_tab():
         first(t)
     for nt in nonterms:
         first(nt)
+    compute_suffix_first()
+
+def compute_suffix_first():
+    # suffix_first[prod][i] is FIRST(prod[i:]) - {EMPTY_STR}
+    # and whether prod[i:] is nullable, for every dot position i,
+    # in one sweep from the end: FIRST(prod[i:]) is FIRST(prod[i])
+    # plus FIRST(prod[i+1:]) if prod[i] is nullable
+    for prods in productions.values():
+        for prod in prods:
+            if prod in suffix_first:
+                continue
+            sufs = [((), True)]
+            for sym in reversed(prod):
+                rest, rest_nullable = sufs[-1]
+                fst = [s for s in first(sym) if s != EMPTY_STR]
+                nullable = EMPTY_STR in first(sym)
+                if nullable:
+                    seen = set(fst)
+                    fst += [s for s in rest if s not in seen]
+                sufs.append((tuple(fst), nullable and rest_nullable))
+            sufs.reverse()
+            suffix_first[prod] = sufs
 
 def compute_follow_tab():
     for nt in nonterms:
@@ -350,15 +415,14 @@ def compute_follow_tab():
                     # if A -> xBy add {FIRST(y) - EMPTY_STR} to FOLLOW(B)
                     if type(sym) == int:
                         continue
-                    for s in first_of_string(prod[i+1:]):
-                        if s == EMPTY_STR:
-                            continue
+                    fst, nullable = suffix_first[prod][i+1]
+                    for s in fst:
                         if s not in follow_tab[sym]:
                             follow_tab[sym].append(s)
                             added_to_follow = True
                     # if A -> xB or (A -> xBy and EMPTY_STR in FIRST(y))
                     # add FOLLOW(A) to FOLLOW(B)
-                    if not prod[i:] or EMPTY_STR in first_of_string(prod[i+1:]):
+                    if nullable:
                         for s in follow_tab[head]:
                             if s not in follow_tab[sym]:
                                 follow_tab[sym].append(s)
@@ -407,8 +471,12 @@ def closure(items):
                 raise Exception("Item dot is beyond bounds")
             if it.dot == len(it.body) or type(it.body[it.dot]) != str:
                 continue
+            # FIRST(y look) for it = [ A -> x.By, look ]
+            fst, nullable = suffix_first[it.body][it.dot+1]
+            if nullable and it.look not in fst:
+                fst = fst + (it.look,)
             for prod in productions[it.body[it.dot]]:
-                for t in first_of_string(list(it.body[it.dot+1:]) + [it.look]):
+                for t in fst:
                     if type(t) != int:
                         continue
                     nit = Item(head=it.body[it.dot], body=prod, dot=0, look=t)
@@ -513,7 +581,23 @@ def get_ck_index(item, from_k, from_sym):
 
     return (k, i)
 
-def compute_look_tab():
+def kern_lookaheads(k):
+    # returns the lookaheads generated spontaneously by the k-th kernel,
+    # as (kernel item, lookahead) pairs, and the propagations from it,
+    # as (index in the k-th kernel, kernel item) pairs. Kernel items are
+    # (kernel, index) pairs, so that the result can be sent by a worker.
+    spont = list()
+    prop = list()
+    for sym in terms + nonterms:
+        sp_gen, props = determine_lookaheads(canon_kerns[k], sym)
+        for lk, items in sp_gen.items():
+            for it in items:
+                spont.append((get_ck_index(it, k, sym), lk))
+        for from_i, tos in props.items():
+            prop += [(from_i, get_ck_index(to, k, sym)) for to in tos]
+    return spont, prop
+
+def compute_look_tab(jobs=1):
     compute_canon_kerns()
 
     propagate = dict()
@@ -535,14 +619,22 @@ def compute_look_tab():
         raise Exception("start_lr0_item not found in canon_kerns[start_state]")
     look_tab[start_state, si_i].append(EOI)
 
-    for k, kern in enumerate(canon_kerns):
-        for sym in terms + nonterms:
-            sp_gen, prop = determine_lookaheads(kern, sym)
-            for lk, items in sp_gen.items():
-                for it in items:
-                    look_tab[get_ck_index(it, k, sym)].append(lk)
-            for from_i, tos in prop.items():
-                propagate[k, from_i] += [get_ck_index(to, k, sym) for to in tos]
+    # every kernel is independent of the others, so with jobs > 1 they
+    # are split among forked workers, which share the grammar and canon.
+    # Pool.map keeps the order of the kernels, so the lookaheads are
+    # merged in the same order as when computed sequentially.
+    kerns = range(len(canon_kerns))
+    if jobs > 1 and "fork" in multiprocessing.get_all_start_methods():
+        with multiprocessing.get_context("fork").Pool(jobs) as pool:
+            chunk = max(1, len(canon_kerns) // (4 * jobs))
+            results = pool.map(kern_lookaheads, kerns, chunk)
+    else:
+        results = map(kern_lookaheads, kerns)
+    for k, (spont, prop) in enumerate(results):
+        for to, lk in spont:
+            look_tab[to].append(lk)
+        for from_i, to in prop:
+            propagate[k, from_i].append(to)
 
     added_to_look = True
     while added_to_look:
@@ -602,22 +694,54 @@ def compute_goto_tab_and_sym_states():
                     state_to_sym[ls] = sym
             goto_tab[i, sym] = l
 
+def prod_prec(body):
+    # the precedence of a production is the one of its rightmost terminal
+    for s in reversed(body):
+        if type(s) == int and s != EMPTY_STR:
+            return prec_tab.get(s, (0, None))[0]
+    return 0
+
+def resolve_shift_reduce(i, t, shift, reduce):
+    lvl, assoc = prec_tab.get(t, (0, None))
+    plvl = prod_prec(reduce[1][1])
+    if not lvl or not plvl:
+        raise Exception(f"Conflict for action_tab[{i}, {t}]")
+    if lvl > plvl or (lvl == plvl and assoc == RIGHT):
+        return shift
+    if lvl < plvl or assoc == LEFT:
+        return reduce
+    return (ERROR, )
+
+def set_action(i, t, act):
+    curr = action_tab.get((i, t))
+    if not curr or curr == act:
+        action_tab[i, t] = act
+        return
+    # already resolved by %nonassoc
+    if curr[0] == ERROR:
+        return
+    if {curr[0], act[0]} != {SHIFT, REDUCE}:
+        raise Exception(f"Conflict for action_tab[{i}, {t}]")
+    shift, reduce = (curr, act) if curr[0] == SHIFT else (act, curr)
+    action_tab[i, t] = resolve_shift_reduce(i, t, shift, reduce)
+    if action_tab[i, t][0] == ERROR:
+        nonassoc_errs.add((i, t))
+
 def compute_action_tab():
+    global tab_n
+
     for i, items in enumerate(lalr_set):
         for it in items:
             if it.dot > len(it.body):
                 raise Exception("Item dot is beyond bounds")
             # if [A -> x.ty, b] is in LALR_SET[i] and GOTO[i, t] = j, then
             # set ACTION[i, t] to (SHIFT, j). t and b are terminals.
-            if it.dot < len(it.body):
+            # `` is never shifted: [A -> .``, b] is a complete item.
+            if it.dot < len(it.body) and it.body[it.dot] != EMPTY_STR:
                 t = it.body[it.dot]
                 if type(t) != int:
                     continue
-                act = (SHIFT, goto_tab[i, t])
-                # check for conflicts
-                if (curr := action_tab.get((i, t))) and curr != act:
-                    raise Exception(f"Conflict for action_tab[{i}, {t}]")
-                action_tab[i, t] = act
+                set_action(i, t, (SHIFT, goto_tab[i, t]))
                 continue
             # if [S' -> S., $] is in LALR_SET[i], then set ACTION[i, $] to ACCEPT
             if it.head == start_sym and it.look == EOI:
@@ -627,19 +751,205 @@ def compute_action_tab():
                 continue
             # if [A -> x., t] is in LALR_SET[i], then set ACTION[i, t] to
             # (REDUCE, A -> x).
-            act = (REDUCE, (it.head, it.body))
-            if (curr := action_tab.get((i, it.look))) and curr != act:
-                raise Exception(f"Conflict for action_tab[{i}, {it.look}]")
-            action_tab[i, it.look] = act
+            set_action(i, it.look, (REDUCE, (it.head, it.body)))
 
     for i in range(lalr_set_n):
         for t in terms:
             if not action_tab.get((i, t)):
                 action_tab[i, t] = (ERROR, )
+    tab_n = lalr_set_n
+
+def is_unit_prod(reduction):
+    head, body = reduction
+    return len(body) == 1 and type(body[0]) == str
+
+def merge_unit_state(t, parts):
+    # the new state acts like t, except on the lookaheads of
+    # every part (head, looks, u), where it acts like u.
+    global tab_n
+
+    gotos = dict()
+    for st in [t] + [u for _, _, u in parts]:
+        for nt in nonterms:
+            g = goto_tab.get((st, nt), ERROR)
+            if g == ERROR:
+                continue
+            if gotos.get(nt, g) != g:
+                return ERROR
+            gotos[nt] = g
+
+    n = tab_n
+    tab_n += 1
+    for sym in terms:
+        goto_tab[n, sym] = goto_tab[t, sym]
+    for lk in terms + [EOI]:
+        if (act := action_tab.get((t, lk))):
+            action_tab[n, lk] = act
+    for nt in nonterms:
+        goto_tab[n, nt] = gotos.get(nt, ERROR)
+    for _, looks, u in parts:
+        for lk in looks:
+            action_tab[n, lk] = action_tab.get((u, lk), (ERROR, ))
+    state_to_sym[n] = state_to_sym[t]
+    return n
+
+def bypass_unit_prods(s, sym, keep, visiting=()):
+    # returns the state to go to from s on sym once every
+    # unit reduction A -> sym (A not in keep) that would
+    # follow has been folded into it.
+    t = goto_tab[s, sym]
+    if t == ERROR or sym in visiting:
+        return t
+    units: dict[str, list[int]] = dict()
+    for lk in terms + [EOI]:
+        act = action_tab.get((t, lk), (ERROR, ))
+        if act[0] != REDUCE or not is_unit_prod(act[1]):
+            continue
+        if act[1][0] in keep:
+            continue
+        units.setdefault(act[1][0], list()).append(lk)
+    if not units:
+        return t
+
+    parts = tuple(
+        (head, tuple(looks),
+            bypass_unit_prods(s, head, keep, visiting + (sym, )))
+        for head, looks in units.items()
+    )
+    if any(u == ERROR for _, _, u in parts):
+        return t
+    if (t, parts) not in unit_merges:
+        unit_merges[t, parts] = merge_unit_state(t, parts)
+    n = unit_merges[t, parts]
+    return t if n == ERROR else n
+
+def elim_unit_prods(keep):
+    # Unit productions A -> B in keep are left alone, since
+    # the runtime needs to see those reductions.
+    s = 0
+    while s < tab_n:
+        for nt in nonterms:
+            if goto_tab.get((s, nt), ERROR) == ERROR:
+                continue
+            goto_tab[s, nt] = bypass_unit_prods(s, nt, keep)
+        s += 1
+
+def compute_default_reds():
+    # The most frequent reduction of every state becomes its
+    # default and the entries it covers are dropped from
+    # action_tab, along with every error entry not set by
+    # %nonassoc. States left with no entries are LR(0) reduce
+    # states: the runtime reduces there without a lookahead.
+    for i in range(tab_n):
+        row = [(lk, action_tab.get((i, lk))) for lk in terms + [EOI]]
+        counts: dict[tuple, int] = dict()
+        for lk, act in row:
+            if act and act[0] == REDUCE:
+                counts[act] = counts.get(act, 0) + 1
+        dflt = max(counts, key=counts.get) if counts else None
+        if dflt:
+            default_tab[i] = dflt
+        for lk, act in row:
+            if not act:
+                continue
+            if act == dflt or (act[0] == ERROR and (i, lk) not in nonassoc_errs):
+                del action_tab[i, lk]
+        if dflt and not any((i, lk) in action_tab for lk in terms + [EOI]):
+            lr0_red_states.add(i)
+
+def fuse_shift_reduce():
+    # A shift of t to an LR(0) reduce state whose reduction
+    # ends in t becomes (SHIFT_REDUCE, state, reduction): the
+    # runtime reduces at once and never pushes that state.
+    # Reductions of an empty B in [A -> x t .B] are left alone.
+    for (i, t), act in action_tab.items():
+        if act[0] != SHIFT or act[1] not in lr0_red_states:
+            continue
+        red = default_tab[act[1]][1]
+        if red[1][-1:] == (t, ):
+            action_tab[i, t] = (SHIFT_REDUCE, act[1], red)
+
+def compute_term_classes():
+    # Terminals with the same column of action_tab in every state
+    # share a class. The runtime maps a token to its class and
+    # looks up class_action_tab[state, class], whose rows are as
+    # wide as the number of classes.
+    cols: dict[tuple, int] = dict()
+    for t in terms + [EOI]:
+        col = tuple(action_tab.get((i, t)) for i in range(tab_n))
+        term_class[t] = cols.setdefault(col, len(cols))
+    for (i, t), act in action_tab.items():
+        class_action_tab[i, term_class[t]] = act
+
+def read_profile(path):
+    # the hits of the states and of the transitions between
+    # them, as lrdriver.write_profile() writes them
+    hits: dict[int, int] = dict()
+    trans: dict[tuple[int, int], int] = dict()
+    with open(path) as f:
+        for line in f:
+            w = line.split()
+            if w[0] == "s":
+                hits[int(w[1])] = int(w[2])
+            elif w[0] == "t":
+                trans[int(w[1]), int(w[2])] = int(w[3])
+    return hits, trans
+
+def profile_order(hits, trans):
+    # The hottest state not placed yet goes next, followed by
+    # the hottest transition out of it to a state not placed
+    # yet, and so on, so that the states the runtime goes
+    # through most often have rows next to each other. States
+    # never hit keep their order, after all the others.
+    succ: dict[int, list[int]] = dict()
+    if any(i >= tab_n for i in hits):
+        raise Exception("the profile does not match the grammar")
+    for (i, j), _ in sorted(trans.items(), key=lambda e: -e[1]):
+        succ.setdefault(i, list()).append(j)
+    order = list()
+    placed = set()
+    for i in sorted(range(tab_n), key=lambda i: -hits.get(i, 0)):
+        while i not in placed:
+            placed.add(i)
+            order.append(i)
+            i = next((j for j in succ.get(i, []) if j not in placed), i)
+    return order
+
+def renumber_states(order):
+    # state order[k] becomes state k in every table
+    global start_state, action_tab, class_action_tab, goto_tab
+    global state_to_sym, default_tab, lr0_red_states
+
+    new = {i: k for k, i in enumerate(order)}
+    if sorted(new) != list(range(tab_n)):
+        raise Exception("the profile does not match the grammar")
+
+    def act(a):
+        if a[0] in (SHIFT, SHIFT_REDUCE):
+            return (a[0], new[a[1]]) + a[2:]
+        return a
+
+    start_state = new[start_state]
+    action_tab = {
+        (new[i], t): act(a) for (i, t), a in sorted(
+            action_tab.items(), key=lambda e: new[e[0][0]])
+    }
+    class_action_tab = {
+        (new[i], c): act(a) for (i, c), a in sorted(
+            class_action_tab.items(), key=lambda e: new[e[0][0]])
+    }
+    goto_tab = {
+        (new[i], sym): j if j == ERROR else new[j]
+        for (i, sym), j in sorted(goto_tab.items(), key=lambda e: new[e[0][0]])
+    }
+    state_to_sym = {new[i]: sym for i, sym in state_to_sym.items()}
+    default_tab = {new[i]: a for i, a in default_tab.items()}
+    lr0_red_states = {new[i] for i in lr0_red_states}
 
 def parse_bn():
     global start_sym, curr_head
     next_token()
+    parse_prec_decls()
     skip_tks("<")
     if tk.type != TK_ID:
         expected("starting nonterm")
@@ -652,15 +962,51 @@ def parse_bn():
     parse_prods()
 
 if __name__ == "__main__":
+    import argparse
+
+    argp = argparse.ArgumentParser(
+        description="build LALR tables for the BN grammar read from stdin"
+    )
+    argp.add_argument(
+        "-u", "--elim-unit", action="store_true",
+        help="bypass unit productions (A -> B) in the generated tables",
+    )
+    argp.add_argument(
+        "--keep-unit", action="append", default=[], metavar="NT",
+        help="keep the unit productions of NT (they have semantic actions)",
+    )
+    argp.add_argument(
+        "-j", "--jobs", type=int, default=1, metavar="N",
+        help="determine the lookaheads with N processes (default: 1)",
+    )
+    argp.add_argument(
+        "--no-fuse", action="store_true",
+        help="keep shifts to LR(0) reduce states apart from the reductions",
+    )
+    argp.add_argument(
+        "--profile", metavar="FILE",
+        help="number the states hottest first by the hits in FILE, "
+        "recorded by parser.py --profile with tables built without it",
+    )
+    args = argp.parse_args()
+
     parse_bn()
     augment_grammar()
     compute_first_tab()
     compute_follow_tab()
     compute_canon()
-    compute_look_tab()
+    compute_look_tab(args.jobs)
     compute_lalr_set()
     compute_goto_tab_and_sym_states()
     compute_action_tab()
+    if args.elim_unit:
+        elim_unit_prods(set(args.keep_unit))
+    compute_default_reds()
+    if not args.no_fuse:
+        fuse_shift_reduce()
+    compute_term_classes()
+    if args.profile:
+        renumber_states(profile_order(*read_profile(args.profile)))
 
     print_action_tab()
     print_goto_tab()
@@ -668,4 +1014,7 @@ if __name__ == "__main__":
 
     import pickle
     with open("lalr-tab", "wb") as f:
-        pickle.dump((start_state, action_tab, goto_tab, state_to_sym), f)
+        pickle.dump((
+            start_state, class_action_tab, term_class, goto_tab,
+            state_to_sym, default_tab, lr0_red_states,
+        ), f)
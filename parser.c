@@ -1,6 +1,7 @@
 #include "grammar.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 
 void parse()
 {
@@ -10,3 +11,39 @@ void parse()
 	putchar('\n');
 	print_follow_tab();
 }
+
+/*
+ * Builds the tables lazily and parses the tokens read from
+ * stdin, printing the reductions. Exits with 1 on a syntax
+ * error.
+ */
+void parse_lazy()
+{
+	parse_bn_lazy();
+	int acc = lazy_parse(stdin, 1);
+	if (mem_report)
+		fprintf(stderr, "%zu states built\n", lazy_n);
+	if (!acc) {
+		fprintf(stderr, "syntax error\n");
+		exit(1);
+	}
+}
+
+/*
+ * Builds the LL(1) table and parses the tokens read from
+ * stdin, printing the expansions. On conflicts, prints the
+ * transformed grammar and exits with 1, as on a syntax error.
+ */
+void parse_ll()
+{
+	parse_bn_ll();
+	if (ll_conflicts) {
+		print_grammar();
+		fprintf(stderr, "%zu LL(1) conflicts\n", ll_conflicts);
+		exit(1);
+	}
+	if (!ll_parse(stdin, 1)) {
+		fprintf(stderr, "syntax error\n");
+		exit(1);
+	}
+}
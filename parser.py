@@ -1,56 +1,94 @@
+import collections
+import os
 import sys
-from collections import namedtuple
 
-from make_tab import repr_sym, SHIFT, REDUCE, ACCEPT
-
-Token = namedtuple("Token", ["type", "str_val"])
-
-tk = Token(0, 0)
-tk_n = 0
-stack = list()
+from make_tab import read_profile, repr_sym
+from lrdriver import Tables, parse, parse_chunked, profile, write_profile
 
 def tk_gen():
-    global tk_n
-    for tk in sys.stdin.readlines():
+    for tk in sys.stdin:
         t, v = tk.split('\t', 1)
-        tk_n += 1
         yield (int(t), v.rstrip())
 
-tokens = tk_gen()
-def next_token():
-    global tk
-    try:
-        tk = Token(*tokens.__next__())
-    except StopIteration:
-        tk = Token(ord('$'), "")
-
-
-def parse():
-    stack.append(start_state)
-
-    next_token()
-    while True:
-        s = stack[-1]
-        act = action_tab[s, tk.type]
-        if act[0] == SHIFT:
-            stack.append(act[1])
-            next_token()
-        elif act[0] == REDUCE:
-            for _ in range(len(act[1][1])):
-                stack.pop()
-            stack.append(goto_tab[stack[-1], act[1][0]])
-            print(act[1][0], "->", [repr_sym(s) for s in act[1][1]])
-        elif act[0] == ACCEPT:
-            break
-        else:
-            print(stack)
-            print(act)
-            raise Exception("Can not handle token", tk.type)
+def print_reduction(head, body):
+    def action(*_):
+        print(head, "->", [repr_sym(s) for s in body])
+    return action
+
+def reduction_lines(head, body):
+    # parse_chunked() runs the actions out of order, so each
+    # returns the lines of its subtree in the order parse()
+    # prints them, moving the smaller runs into the largest
+    line = f"{head} -> {[repr_sym(s) for s in body]}"
+    def action(*vals):
+        kids = [v for v in vals if type(v) is collections.deque]
+        if not kids:
+            return collections.deque([line])
+        big = max(range(len(kids)), key=lambda k: len(kids[k]))
+        lines = kids[big]
+        for k in reversed(range(big)):
+            lines.extendleft(reversed(kids[k]))
+        for k in range(big + 1, len(kids)):
+            lines.extend(kids[k])
+        lines.append(line)
+        return lines
+    return action
+
+def profile_streams(tabs, path):
+    # counts the hits over the inputs on stdin, separated by
+    # empty lines, adding them to those already in path
+    hits, trans = dict(), dict()
+    if os.path.exists(path):
+        hits, trans = read_profile(path)
+    types = list()
+    for tk in sys.stdin.readlines() + [""]:
+        if tk.strip():
+            types.append(int(tk.split('\t', 1)[0]))
+        elif types:
+            profile(tabs, types, hits, trans)
+            types = list()
+    write_profile(path, hits, trans)
+
+def tk_type(s):
+    # a token type, given as a number or as its character
+    return int(s) if s.isdigit() else ord(s)
 
 
 if __name__ == "__main__":
+    import argparse
     import pickle
+
+    argp = argparse.ArgumentParser(
+        description="parse the tokens read from stdin with lalr-tab"
+    )
+    argp.add_argument(
+        "-j", "--jobs", type=int, default=1, metavar="N",
+        help="parse chunks of the input in N processes",
+    )
+    argp.add_argument(
+        "--sync", action="append", type=tk_type, default=[], metavar="T",
+        help="token type (or its character) the input may be split after",
+    )
+    argp.add_argument(
+        "--profile", metavar="FILE",
+        help="instead of parsing, add the hits of the states over the "
+        "inputs, separated by empty lines, to FILE for make_tab.py",
+    )
+    args = argp.parse_args()
+
     with open("lalr-tab", "rb") as f:
-        start_state, action_tab, goto_tab, sym_states = pickle.load(f)
+        tabs = Tables(*pickle.load(f))
+
+    if args.profile:
+        profile_streams(tabs, args.profile)
+        sys.exit()
 
-    parse()
+    if args.jobs > 1 and args.sync:
+        actions = {prod: reduction_lines(*prod) for prod in tabs.prods}
+        lines = parse_chunked(
+            tabs, tk_gen(), set(args.sync), args.jobs, actions
+        )
+        print("\n".join(lines))
+    else:
+        actions = {prod: print_reduction(*prod) for prod in tabs.prods}
+        parse(tabs, tk_gen(), actions)
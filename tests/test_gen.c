@@ -0,0 +1,187 @@
+#include "../gen.c"
+
+#include <stdio.h>
+
+void test_compute_lens()
+{
+	init_lexer("./tests/arith_expr.bn");
+	read_bn();
+	init_gen();
+	assert(min_len[nt_num("expr")] == 1);
+	assert(min_len[nt_num("fact")] == 1);
+	assert(max_len[nt_num("expr")] == LEN_INF);
+	/* fact -> `float` */
+	assert(prod_min[min_prod[nt_num("fact")]] == 1);
+
+	init_lexer("./tests/sample_grammar.bn");
+	read_bn();
+	init_gen();
+	/* stmt -> `{` <stmtlist> `}` */
+	assert(min_len[nt_num("stmt")] == 2);
+	assert(min_len[nt_num("stmtlist")] == 0);
+	assert(min_len[nt_num("optexpr")] == 0);
+	assert(min_len[nt_num("expr")] == 1);
+
+	/* past the maximum depth, only the shortest derivations */
+	gen_max_depth = 0;
+	FILE *f = tmpfile();
+	gen_sentence(1000, f);
+	rewind(f);
+	int tt;
+	assert(fscanf(f, "%d\t%*s", &tt) == 1 && tt == TK_LBRCE);
+	assert(fscanf(f, "%d\t%*s", &tt) == 1 && tt == TK_RBRCE);
+	assert(fscanf(f, "%d\t%*s", &tt) == EOF);
+	fclose(f);
+	gen_max_depth = LEN_INF;
+
+	printf("%s passed\n", __func__);
+}
+
+void test_gen_sentence()
+{
+	const char *bns[] = {
+		"./tests/arith_expr.bn", "./tests/sample_grammar.bn",
+		"./tests/follow_cycle.bn", "./tests/prec_arith_expr.bn",
+	};
+	for (size_t i = 0; i < sizeof(bns) / sizeof(*bns); i++) {
+		init_lexer(bns[i]);
+		parse_bn();
+		init_gen();
+		seed_gen(i);
+		for (size_t len = 1; len < 300; len += 37) {
+			FILE *f = tmpfile();
+			size_t bytes = gen_sentence(len, f);
+			assert((long) bytes == ftell(f));
+			rewind(f);
+			assert(lr_parse(f, 0));
+			fclose(f);
+		}
+	}
+
+	init_lexer("./tests/arith_expr.bn");
+	read_bn();
+	init_gen();
+
+	/* fact -> `(` <expr> `)` left out */
+	set_prod_weight("fact", 2, 0);
+	FILE *f = tmpfile();
+	gen_sentence(1000, f);
+	rewind(f);
+	int tt;
+	while (fscanf(f, "%d\t%*s", &tt) == 1)
+		assert(tt != TK_LPAR);
+	fclose(f);
+
+	printf("%s passed\n", __func__);
+}
+
+/* Returns a copy of the tokens of f without the k-th one. */
+FILE *drop_token(FILE *f, size_t k)
+{
+	FILE *g = tmpfile();
+	char line[256];
+	rewind(f);
+	for (size_t n = 0; fgets(line, sizeof(line), f) != NULL; n++)
+		if (n != k)
+			fputs(line, g);
+	rewind(f);
+	rewind(g);
+	return g;
+}
+
+/*
+ * Fills fs[0] to fs[n-1] with sentences of the grammar of
+ * parse_bn(), each even one followed by a copy without its
+ * k-th token, and sets acc[k] to whether lr_parse() accepts
+ * fs[k], asserting that every sentence is accepted. Leaves
+ * the files rewound.
+ */
+void make_corpus(FILE **fs, int *acc, size_t n, uint64_t seed)
+{
+	init_gen();
+	seed_gen(seed);
+	for (size_t k = 0; k + 1 < n; k += 2) {
+		fs[k] = tmpfile();
+		gen_sentence(10 + 20 * k, fs[k]);
+		fs[k+1] = drop_token(fs[k], k);
+		acc[k] = lr_parse(fs[k], 0);
+		acc[k+1] = lr_parse(fs[k+1], 0);
+		assert(acc[k]);
+		rewind(fs[k]);
+		rewind(fs[k+1]);
+	}
+}
+
+void test_lazy_parse()
+{
+	const char *bns[] = {
+		"./tests/arith_expr.bn", "./tests/sample_grammar.bn",
+		"./tests/follow_cycle.bn", "./tests/prec_arith_expr.bn",
+	};
+	for (size_t i = 0; i < sizeof(bns) / sizeof(*bns); i++) {
+		FILE *fs[16];
+		int acc[16];
+		init_lexer(bns[i]);
+		parse_bn();
+		size_t eager_n = lr0_n;
+		make_corpus(fs, acc, 16, i);
+
+		init_lexer(bns[i]);
+		parse_bn_lazy();
+		assert(lazy_n == 1);
+		for (size_t k = 0; k < 16; k++) {
+			assert(lazy_parse(fs[k], 0) == acc[k]);
+			assert(lazy_n <= eager_n);
+			fclose(fs[k]);
+		}
+	}
+
+	/* { } reaches few of the states of sample_grammar.bn */
+	init_lexer("./tests/sample_grammar.bn");
+	parse_bn();
+	size_t eager_n = lr0_n;
+	init_lexer("./tests/sample_grammar.bn");
+	parse_bn_lazy();
+	FILE *f = tmpfile();
+	fprintf(f, "%d\t{\n%d\t}\n", TK_LBRCE, TK_RBRCE);
+	rewind(f);
+	assert(lazy_parse(f, 0));
+	assert(lazy_n < eager_n / 2);
+	fclose(f);
+
+	printf("%s passed\n", __func__);
+}
+
+void test_ll_parse()
+{
+	const char *bns[] = {
+		"./tests/arith_expr.bn", "./tests/sample_grammar.bn",
+		"./tests/follow_cycle.bn", "./tests/reduced_arith_expr.bn",
+	};
+	for (size_t i = 0; i < sizeof(bns) / sizeof(*bns); i++) {
+		FILE *fs[16];
+		int acc[16];
+		init_lexer(bns[i]);
+		parse_bn();
+		make_corpus(fs, acc, 16, i);
+
+		/* the transformed grammar derives the same sentences */
+		init_lexer(bns[i]);
+		parse_bn_ll();
+		assert(ll_conflicts == 0);
+		for (size_t k = 0; k < 16; k++) {
+			assert(ll_parse(fs[k], 0) == acc[k]);
+			fclose(fs[k]);
+		}
+	}
+
+	printf("%s passed\n", __func__);
+}
+
+void test_gen()
+{
+	test_compute_lens();
+	test_gen_sentence();
+	test_lazy_parse();
+	test_ll_parse();
+}
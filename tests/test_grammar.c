@@ -85,6 +85,7 @@ void test_add_prod()
 	LOOK_UP(phe, curr_head, productions);
 	assert(phe == NULL);
 	struct prod_head_entry *_e = malloc(sizeof(struct prod_head_entry));
+	_e->prods = NULL;
 	INSERT_ENTRY(_e, curr_head, productions);
 	LOOK_UP(phe, curr_head, productions);
 	assert(phe != NULL);
@@ -338,60 +339,139 @@ void test_compute_first_tab()
 	printf("%s passed\n", __func__);
 }
 
-void test_first_of_sym_list()
+void test_first_left_rec_nullable()
 {
-	init_lexer("./tests/arith_expr.bn");
+	/* A and B are mutually left-recursive through
+	 * the nullable A, so they form one component.
+	 */
+	init_lexer("./tests/left_rec_nullable.bn");
 	init_grammar();
 	parse_bn();
 
+	struct symbol *s = malloc(sizeof(struct symbol));
+	s->is_term = 0;
+	s->nt_name = "A";
+	size_t a = sym_index(s) - TK_TYPE_COUNT;
+	s->nt_name = "B";
+	size_t b = sym_index(s) - TK_TYPE_COUNT;
+	s->nt_name = "S";
+	size_t ss = sym_index(s) - TK_TYPE_COUNT;
+	assert(BIT_TEST(nullable_nts, a));
+	assert(!BIT_TEST(nullable_nts, b));
+	assert(!BIT_TEST(nullable_nts, ss));
+	assert(first_sets[a] == first_sets[b]);
+
+	/* FIRST(A) = { `(`, `` } */
+	s->nt_name = "A";
+	struct sym_list *f = first(s);
+	assert(f != NULL && f->next != NULL && f->next->next == NULL);
+	assert(sym_in_sym_list(&es_sym, f));
+	/* FIRST(B) = { `(` } */
+	s->nt_name = "B";
+	f = first(s);
+	assert(f != NULL && f->next == NULL);
+	assert(f->sym->term_type == TK_LPAR);
+	/* FIRST(S) = { `(`, `)` } */
+	s->nt_name = "S";
+	f = first(s);
+	assert(f != NULL && f->next != NULL && f->next->next == NULL);
+	assert(!sym_in_sym_list(&es_sym, f));
+	s->is_term = 1;
+	s->term_type = TK_RPAR;
+	assert(sym_in_sym_list(s, f));
 
-	/* first_of_sym_list("expr"->"fact"->TK_RPAR) == { `(`, `TK_ID` } */
+	printf("%s passed\n", __func__);
+}
 
-	struct sym_list *sl = NULL;
-	struct symbol *s = make_symbol(1, TK_RPAR, NULL);
-	add_sym_to_list(s, &sl);
-	s = make_symbol(0, 0, "fact");
-	add_sym_to_list(s, &sl);
-	s = make_symbol(0, 0, "expr");
-	add_sym_to_list(s, &sl);
-	struct sym_list *fosl = first_of_sym_list(sl);
-	assert(fosl != NULL);
-	assert(fosl->next != NULL);
-	assert(fosl->next->next == NULL);
+/* Returns the number of the k-th production of nt_name. */
+size_t nth_prod(const char *nt_name, size_t k)
+{
+	struct symbol nt = {0, 0, nt_name};
+	size_t j = sym_index(&nt) - TK_TYPE_COUNT;
+	assert(nt_prods[j] + k < nt_prods[j+1]);
+	return nt_prods[j] + k;
+}
 
-	s = make_symbol(1, TK_LPAR, NULL);
-	assert(sym_in_sym_list(s, fosl));
+void test_suffix_first()
+{
+	init_lexer("./tests/left_rec_nullable.bn");
+	init_grammar();
+	parse_bn();
 
-	s->term_type = TK_ID;
-	assert(sym_in_sym_list(s, fosl));
+	/* S -> A `)`: FIRST(A `)`) = { `(`, `)` } */
+	size_t x = ITEM_POS(nth_prod("S", 0), 0);
+	assert(!BIT_TEST(nullable_suffixes, x));
+	assert(BIT_TEST(suffix_first[x], TK_LPAR));
+	assert(BIT_TEST(suffix_first[x], TK_RPAR));
+	assert(!BIT_TEST(suffix_first[x+1], TK_LPAR));
+	assert(BIT_TEST(suffix_first[x+1], TK_RPAR));
+	assert(BIT_TEST(nullable_suffixes, x+2));
+
+	/* A -> ``: the suffix is nullable with an empty FIRST */
+	size_t p = nth_prod("A", 0);
+	if (PROD_LEN(p) != 0)
+		p = nth_prod("A", 1);
+	x = ITEM_POS(p, 0);
+	assert(BIT_TEST(nullable_suffixes, x));
+	for (size_t tt = 0; tt < TK_TYPE_COUNT; tt++)
+		assert(!BIT_TEST(suffix_first[x], tt));
 
-	s->term_type = TK_RPAR;
-	assert(!sym_in_sym_list(s, fosl));
+	printf("%s passed\n", __func__);
+}
 
-	s->term_type = TK_ASTK;
-	assert(!sym_in_sym_list(s, fosl));
+void test_follow_cycle()
+{
+	/* A and B end each other's productions,
+	 * so FOLLOW(A) = FOLLOW(B) = { `;` }.
+	 */
+	init_lexer("./tests/follow_cycle.bn");
+	init_grammar();
+	parse_bn();
 
-	/* first_of_sym_list(TK_RPAR->"expr") == { `)` } */
-	s = make_symbol(0, 0, "expr");
-	add_sym_to_list(s, &sl);
-	s = make_symbol(1, TK_RPAR, "fact");
-	add_sym_to_list(s, &sl);
-	fosl = first_of_sym_list(sl);
-	assert(fosl != NULL);
-	assert(fosl->next == NULL);
+	struct symbol *s = malloc(sizeof(struct symbol));
+	s->is_term = 0;
+	s->nt_name = "A";
+	size_t a = sym_index(s) - TK_TYPE_COUNT;
+	s->nt_name = "B";
+	size_t b = sym_index(s) - TK_TYPE_COUNT;
+	assert(follow_sets[a] == follow_sets[b]);
 
-	s->is_term = 1;
-	s->term_type = TK_RPAR;
-	assert(sym_in_sym_list(s, fosl));
+	struct sym_list_entry *fle;
+	LOOK_UP(fle, "B", follow_tab);
+	assert(fle != NULL);
+	assert(fle->sl != NULL && fle->sl->next == NULL);
+	assert(fle->sl->sym->term_type != EOI);
+	assert(BIT_TEST(follow_sets[b], fle->sl->sym->term_type));
 
-	s->term_type = TK_LPAR;
-	assert(!sym_in_sym_list(s, fosl));
+	/* FOLLOW(S) = { $ } */
+	LOOK_UP(fle, "S", follow_tab);
+	assert(fle != NULL);
+	assert(fle->sl != NULL && fle->sl->next == NULL);
+	assert(fle->sl->sym->term_type == EOI);
 
-	s->term_type = TK_ID;
-	assert(!sym_in_sym_list(s, fosl));
+	printf("%s passed\n", __func__);
+}
 
-	s->term_type = TK_ASTK;
-	assert(!sym_in_sym_list(s, fosl));
+void test_first_of_suffix()
+{
+	init_lexer("./tests/arith_expr.bn");
+	init_grammar();
+	parse_bn();
+
+	/* fact -> `(` expr `)`: FIRST(expr `)`) == { `(`, `TK_ID` } */
+	size_t p = nth_prod("fact", 0);
+	if (PROD_LEN(p) != 3)
+		p = nth_prod("fact", 1);
+	size_t x = ITEM_POS(p, 1);
+	assert(!BIT_TEST(nullable_suffixes, x));
+	for (size_t tt = 0; tt < TK_TYPE_COUNT; tt++)
+		assert(BIT_TEST(suffix_first[x], tt)
+					== (tt == TK_LPAR || tt == TK_ID));
+
+	/* FIRST(`)`) == { `)` } */
+	assert(!BIT_TEST(nullable_suffixes, x+1));
+	for (size_t tt = 0; tt < TK_TYPE_COUNT; tt++)
+		assert(BIT_TEST(suffix_first[x+1], tt) == (tt == TK_RPAR));
 
 	printf("%s passed\n", __func__);
 }
@@ -477,7 +557,6 @@ void test_parse_bn()
 	assert(sym_in_sym_list(s, nts_in_grammar));
 	LOOK_UP(phe, s->nt_name, productions);
 	assert(phe != NULL);
-	assert(phe->next == NULL);
 	prdp = phe->prods;
 	assert(prdp != NULL);
 	assert(prdp->next == NULL);
@@ -561,87 +640,13 @@ void test_print_item()
 	printf("%s passed\n", __func__);
 }
 
-void test_itm_in_itm_list()
-{
-	/* item list = it1->it2->it3->NULL
-	 * it1:
-	 * 	head="head1",
-	 * 	body=nt1->TK_CMPL->nt2->NULL,
-	 * 	dot=nt2->NULL
-	 * it2:
-	 * 	head="head2",
-	 * 	body=nt1->TK_LESS->nt2->NULL,
-	 * 	dot=nt2->NULL
-	 * it3:
-	 * 	head="head3",
-	 * 	body=nt1->TK_GRT->nt2->NULL,
-	 * 	dot=nt2->NULL
-	 */
-	struct item *it1, *it2, *it3;
-	struct sym_list *b = NULL;
-	struct sym_list *d;
-	struct symbol *s;
-	s = make_symbol(0, 0, "nt2");
-	add_sym_to_list(s, &b);
-	s = make_symbol(1, TK_CMPL, NULL);
-	add_sym_to_list(s, &b);
-	s = make_symbol(0, 0, "nt1");
-	add_sym_to_list(s, &b);
-	d = b->next->next;
-	it1 = make_item("head1", b, d);
-
-	b = d = NULL;
-	s = make_symbol(0, 0, "nt2");
-	add_sym_to_list(s, &b);
-	add_sym_to_list(s, &d);
-	s = make_symbol(1, TK_LESS, NULL);
-	add_sym_to_list(s, &b);
-	s = make_symbol(0, 0, "nt1");
-	add_sym_to_list(s, &b);
-	it2 = make_item("head2", b, d);
-
-	b = d = NULL;
-	s = make_symbol(0, 0, "nt2");
-	add_sym_to_list(s, &b);
-	add_sym_to_list(s, &d);
-	s = make_symbol(1, TK_GRT, NULL);
-	add_sym_to_list(s, &b);
-	s = make_symbol(0, 0, "nt1");
-	add_sym_to_list(s, &b);
-	it3 = make_item("head3", b, d);
-
-	struct itm_list *il = NULL;
-	add_itm_to_list(it1, &il);
-	add_itm_to_list(it2, &il);
-	add_itm_to_list(it3, &il);
-
-	assert(itm_in_itm_list(it1, il));
-	assert(itm_in_itm_list(it2, il));
-	assert(itm_in_itm_list(it3, il));
-
-	struct item *it4 = make_item("head4", it1->body, it1->dot);
-	assert(!itm_in_itm_list(it4, il));
-
-	struct item *it;
-	it = make_item("head1", it1->body, it1->body->next);
-	assert(!itm_in_itm_list(it, il));
-
-	it = make_item("head1", it1->body, it1->body);
-	assert(!itm_in_itm_list(it, il));
-
-	it = make_item("head1", it1->dot, it1->body);
-	assert(!itm_in_itm_list(it, il));
-
-	it = make_item("head1", NULL, it1->body);
-	assert(!itm_in_itm_list(it, il));
-
-	it = make_item("head1", it1->body, it1->dot);
-	assert(itm_in_itm_list(it, il));
-
-	it = make_item("head1", it1->body, it1->body->next->next);
-	assert(itm_in_itm_list(it, il));
-
-	printf("%s passed\n", __func__);
+/* Returns 1 if the sorted set of n items in itms holds itm. */
+int has_itm(const uint32_t *itms, size_t n, uint32_t itm)
+{
+	for (size_t k = 0; k < n; k++)
+		if (itms[k] == itm)
+			return 1;
+	return 0;
 }
 
 void test_closure()
@@ -651,94 +656,126 @@ void test_closure()
 	parse_bn();
 
 	/* check closure of [ E' -> .E ] */
-	struct prod_head_entry *phe;
-	LOOK_UP(phe, "expr_s", productions);
-	struct item *si;
-	si = make_item("expr_s", phe->prods->prod, phe->prods->prod);
-	struct itm_list *sil = NULL;
-	add_itm_to_list(si, &sil);
-
-	struct itm_list *c = closure(sil);
+	uint32_t si = ITEM(nth_prod("expr_s", 0), 0);
+	uint32_t *c;
+	size_t n = lr0_closure(&si, 1, &c);
 
-	/* [ E' -> .E ] must be in c */
-	assert(itm_in_itm_list(si, c));
-
-	struct item *it = malloc(sizeof(struct item));
-
-	/* an item for every E prod must be in c:
-	 * [ E -> .T ], [ E -> .E + T ], [ E -> .E - T ]
+	/* [ E' -> .E ] and an item for every E, T and F prod:
+	 * [ E -> .T ], [ E -> .E + T ], [ E -> .E - T ],
+	 * [ T -> .F ], [ T -> .T * F ], [ T -> .T / F ],
+	 * [ F -> .id ], [ F -> .( E ) ]
 	 */
-	LOOK_UP(phe, "expr", productions);
-	it->head = "expr";
+	assert(n == prods_n);
 	printf("CLOSURE({ ");
-	print_item(si);
+	print_item(lr0_itms[ITEM_POS(ITEM_PROD(si), 0)]);
 	printf(" }) = {\n");
-	for (; phe->prods != NULL; phe->prods = phe->prods->next) {
-		it->body = phe->prods->prod;
-		it->dot = phe->prods->prod;
+	for (size_t p = 0; p < prods_n; p++) {
+		assert(has_itm(c, n, ITEM(p, 0)));
+		assert(p == 0 || c[p-1] < c[p]);
 		putchar('\t');
-		print_item(it);
+		print_item(lr0_itms[ITEM_POS(p, 0)]);
 		printf(",\n");
-		assert(itm_in_itm_list(it, c));
 	}
+	printf("}\n");
+	free_lr0_closure(c, 1);
 
-	/* an item for every T prod must be in c:
-	 * [ T -> .F ], [ T -> .T * F ], [ T -> .T / F ]
-	 */
-	LOOK_UP(phe, "term", productions);
-	it->head = "term";
-	for (; phe->prods != NULL; phe->prods = phe->prods->next) {
-		it->body = phe->prods->prod;
-		it->dot = phe->prods->prod;
-		putchar('\t');
-		print_item(it);
-		printf(",\n");
-		assert(itm_in_itm_list(it, c));
-	}
+	printf("%s passed\n", __func__);
+}
 
-	/* an item for every F prod must be in c:
-	 * [ F -> .id ], [ F -> .( E ) ]
+size_t count_clos_prods(const char *nt_name)
+{
+	struct symbol nt = {0, 0, nt_name};
+	size_t j = sym_index(&nt) - TK_TYPE_COUNT;
+	size_t n = 0;
+	for (size_t p = 0; p < prods_n; p++)
+		if (BIT_TEST(clos_tab[j], p))
+			++n;
+	return n;
+}
+
+void test_compute_clos_tab()
+{
+	init_lexer("./tests/arith_expr.bn");
+	init_grammar();
+	parse_bn();
+
+	/* 3 expr, 3 term and 2 fact prods, plus expr_s -> expr */
+	assert(prods_n == 9);
+	assert(count_clos_prods("fact") == 2);
+	assert(count_clos_prods("term") == 5);
+	assert(count_clos_prods("expr") == 8);
+	assert(count_clos_prods("expr_s") == 9);
+
+	/* every production of fact and none of expr_s
+	 * is added when the dot is before term.
 	 */
-	LOOK_UP(phe, "fact", productions);
-	it->head = "fact";
-	for (; phe->prods != NULL; phe->prods = phe->prods->next) {
-		it->body = phe->prods->prod;
-		it->dot = phe->prods->prod;
-		putchar('\t');
-		print_item(it);
-		printf(",\n");
-		assert(itm_in_itm_list(it, c));
+	struct symbol nt = {0, 0, "term"};
+	size_t j = sym_index(&nt) - TK_TYPE_COUNT;
+	for (size_t p = 0; p < prods_n; p++) {
+		if (strcmp(lr0_itms[ITEM_POS(p, 0)]->head, "fact") == 0)
+			assert(BIT_TEST(clos_tab[j], p));
+		if (strcmp(lr0_itms[ITEM_POS(p, 0)]->head, "expr_s") == 0)
+			assert(!BIT_TEST(clos_tab[j], p));
 	}
-	printf("}\n");
 
 	printf("%s passed\n", __func__);
 }
 
-void test_find_itm_list_in_canon_set()
+void test_packed_items()
 {
-	canon_set = NULL;
-	/* add { [ E' -> E. ], [ E -> E .+ T ] } to canon_set */
-	struct prod_head_entry *phe;
-	LOOK_UP(phe, "expr_s", productions);
-	struct item *it1;
-	it1 = make_item("expr_s", phe->prods->prod,
-				phe->prods->prod->next);
+	init_lexer("./tests/left_rec_nullable.bn");
+	init_grammar();
+	parse_bn();
+	/* A -> B `+` | `` packs `` as an empty production */
+	struct symbol a = {0, 0, "A"};
+	size_t j = sym_index(&a) - TK_TYPE_COUNT;
+	assert(nt_prods[j+1] - nt_prods[j] == 2);
+	assert(PROD_LEN(nt_prods[j]) == 2 || PROD_LEN(nt_prods[j+1]-1) == 2);
+	assert(PROD_LEN(nt_prods[j]) == 0 || PROD_LEN(nt_prods[j+1]-1) == 0);
+
+	init_lexer("./tests/arith_expr.bn");
+	init_grammar();
+	parse_bn();
+
+	for (size_t p = 0; p < prods_n; p++) {
+		/* the item at the end of a production has no dot */
+		assert(lr0_itms[ITEM_POS(p, PROD_LEN(p))]->dot == NULL);
+		struct sym_list *sl = lr0_itms[ITEM_POS(p, 0)]->body;
+		for (size_t d = 0; d < PROD_LEN(p); d++, sl = sl->next) {
+			assert(ITEM_PROD(ITEM(p, d)) == p);
+			assert(ITEM_DOT(ITEM(p, d)) == d);
+			assert(prod_syms[prod_off[p] + d] == sym_index(sl->sym));
+			assert(lr0_itms[ITEM_POS(p, d)]->dot == sl);
+		}
+		assert(sl == NULL);
+	}
 
-	struct item *it2 = make_item("expr", NULL, NULL);
-	add_sym_to_list(make_symbol(0, 0, "term"), &it2->body);
-	add_sym_to_list(make_symbol(1, TK_PLUS, NULL), &it2->body);
-	add_sym_to_list(make_symbol(0, 0, "expr"), &it2->body);
-	it2->dot = it2->body->next;
+	/* same states as the canonical collection */
+	compute_canon_set();
+	assert(lr0_n == 16);
+	assert(lr0_kern_ns[0] == 1);
+	assert(prod_head[ITEM_PROD(lr0_kerns[0][0])] == sym_index(
+		&(struct symbol) {0, 0, "expr_s"}) - TK_TYPE_COUNT);
 
-	struct itm_list *itl = NULL;
-	add_itm_to_list(it2, &itl);
-	add_itm_to_list(it1, &itl);
+	printf("%s passed\n", __func__);
+}
 
-	struct itm_list_list *itllnk = malloc(sizeof(struct itm_list_list));
-	itllnk->il = itl;
-	ADD_LINK(itllnk, canon_set);
+void test_add_lr0_state()
+{
+	init_lexer("./tests/arith_expr.bn");
+	init_grammar();
+	parse_bn();
+	compute_canon_set();
 
-	assert(find_itm_list_in_canon_set(itl) == itl);
+	/* every kernel is found again as the same state */
+	size_t n = lr0_n;
+	for (size_t i = 0; i < n; i++) {
+		uint32_t *kern = mem_alloc(lr0_kern_ns[i] * sizeof(uint32_t),
+								MEM_STATE);
+		memcpy(kern, lr0_kerns[i], lr0_kern_ns[i] * sizeof(uint32_t));
+		assert(add_lr0_state(kern, lr0_kern_ns[i]) == i);
+		assert(lr0_n == n);
+	}
 
 	printf("%s passed\n", __func__);
 }
@@ -749,37 +786,40 @@ void test_go_to()
 	init_grammar();
 	parse_bn();
 
-	/* check goto of {[ E' -> E. ], [ E -> E .+ T ] } */
-	struct prod_head_entry *phe;
-	LOOK_UP(phe, "expr_s", productions);
-	struct item *it1;
-	it1 = make_item("expr_s", phe->prods->prod,
-				phe->prods->prod->next);
-
-	struct item *it2 = make_item("expr", NULL, NULL);
-	add_sym_to_list(make_symbol(0, 0, "term"), &it2->body);
-	add_sym_to_list(make_symbol(1, TK_PLUS, NULL), &it2->body);
-	add_sym_to_list(make_symbol(0, 0, "expr"), &it2->body);
-	it2->dot = it2->body->next;
-
-	struct itm_list *itl = NULL;
-	add_itm_to_list(it2, &itl);
-	add_itm_to_list(it1, &itl);
-
-	struct itm_list *go = go_to(itl, it2->dot->sym);
+	/* GOTO on E of { [ E' -> .E ], ... } is
+	 * { [ E' -> E. ], [ E -> E .+ T ], [ E -> E .- T ] }
+	 */
+	uint32_t *c;
+	init_lr0_states();
+	expand_lr0_state(0, &c);
+	free_lr0_closure(c, 1);
+	size_t e = lr0_trans[0][sym_index(&(struct symbol) {0, 0, "expr"})];
+	assert(e != NO_STATE && lr0_kern_ns[e] == 3);
+
+	/* GOTO on `+` of it is the kernel [ E -> E + .T ] */
+	expand_lr0_state(e, &c);
+	free_lr0_closure(c, lr0_kern_ns[e]);
+	size_t t = lr0_trans[e][TK_PLUS];
+	assert(t != NO_STATE && lr0_kern_ns[t] == 1);
+	size_t n = expand_lr0_state(t, &c);
+	assert(n == 6);
 	printf("GOTO({ ");
-	print_item(it1);
-	printf(", ");
-	print_item(it2);
+	for (size_t k = 0; k < lr0_kern_ns[e]; k++) {
+		print_item(lr0_itms[ITEM_POS(ITEM_PROD(lr0_kerns[e][k]),
+					ITEM_DOT(lr0_kerns[e][k]))]);
+		printf(k + 1 < lr0_kern_ns[e] ? ", " : "");
+	}
 	printf(" }, `+`) = {\n");
-	for (; go != NULL; go = go->next) {
+	for (size_t k = 0; k < n; k++) {
 		putchar('\t');
-		print_item(go->itm);
+		print_item(lr0_itms[ITEM_POS(ITEM_PROD(c[k]),
+						ITEM_DOT(c[k]))]);
 		printf(",\n");
 	}
 	printf("}\n");
+	free_lr0_closure(c, lr0_kern_ns[t]);
 
-	printf("%s: check output above\n", __func__);
+	printf("%s passed\n", __func__);
 }
 
 void test_compute_canon_set()
@@ -807,6 +847,305 @@ void test_compute_action_tab()
 	printf("%s: check output above\n", __func__);
 }
 
+/*
+ * Returns the index of the state that holds the complete
+ * item [ head -> body. ] whose body is `nt op nt`.
+ */
+size_t find_binop_red_state(const char *head, enum tk_type op)
+{
+	for (size_t i = 0; i < canon_coll_n; i++) {
+		struct itm_list *il = canon_coll[i];
+		for (; il != NULL; il = il->next) {
+			struct sym_list *b = il->itm->body;
+			if (il->itm->dot != NULL || strcmp(il->itm->head, head))
+				continue;
+			if (b->next == NULL || !b->next->sym->is_term)
+				continue;
+			if (b->next->sym->term_type == op)
+				return i;
+		}
+	}
+	return canon_coll_n;
+}
+
+void test_prec_decls()
+{
+	init_lexer("./tests/prec_arith_expr.bn");
+	parse_bn();
+
+	assert(term_prec[TK_PLUS] == 1);
+	assert(term_prec[TK_MINUS] == 1);
+	assert(term_prec[TK_ASTK] == 2);
+	assert(term_prec[TK_DIV] == 2);
+	assert(term_prec[TK_LPAR] == 0);
+	assert(term_assoc[TK_PLUS] == ASSOC_LEFT);
+	assert(term_assoc[TK_ASTK] == ASSOC_LEFT);
+
+	/* in [ E -> E + E. ], `*` shifts and `+`, `)`, `$` reduce */
+	size_t i = find_binop_red_state("expr", TK_PLUS);
+	assert(i < canon_coll_n);
+	assert(action_tab[i][TK_ASTK]->type == ACT_SHFT);
+	assert(action_tab[i][TK_DIV]->type == ACT_SHFT);
+	assert(action_tab[i][TK_PLUS]->type == ACT_RED);
+	assert(action_tab[i][TK_MINUS]->type == ACT_RED);
+	assert(action_tab[i][TK_RPAR]->type == ACT_RED);
+	assert(action_tab[i][EOI]->type == ACT_RED);
+
+	/* in [ E -> E * E. ], every operator reduces */
+	i = find_binop_red_state("expr", TK_ASTK);
+	assert(i < canon_coll_n);
+	assert(action_tab[i][TK_ASTK]->type == ACT_RED);
+	assert(action_tab[i][TK_DIV]->type == ACT_RED);
+	assert(action_tab[i][TK_PLUS]->type == ACT_RED);
+	assert(action_tab[i][TK_MINUS]->type == ACT_RED);
+
+	printf("%s passed\n", __func__);
+}
+
+/*
+ * Sets up n states with every action set to error
+ * and no gotos, for nt_n nonterminals.
+ */
+void make_empty_tabs(size_t n, size_t nt_n)
+{
+	canon_coll_n = n;
+	nts_n = nt_n;
+	canon_coll = mem_calloc(n, sizeof(struct itm_list *), MEM_TABLE);
+	action_tab = mem_alloc(n * sizeof(struct action_entry **), MEM_TABLE);
+	goto_tab = mem_alloc(n * sizeof(size_t *), MEM_TABLE);
+	for (size_t i = 0; i < n; i++) {
+		action_tab[i] = mem_alloc(TK_TYPE_COUNT *
+				sizeof(struct action_entry *), MEM_TABLE);
+		for (enum tk_type tt = 0; tt < TK_TYPE_COUNT; tt++) {
+			action_tab[i][tt] = mem_calloc(1,
+					sizeof(struct action_entry), MEM_ACTION);
+			action_tab[i][tt]->type = ACT_ERR;
+		}
+		goto_tab[i] = mem_alloc(nt_n * sizeof(size_t), MEM_TABLE);
+		for (size_t j = 0; j < nt_n; j++)
+			goto_tab[i][j] = n;
+	}
+}
+
+void set_shift(size_t i, enum tk_type tt, size_t to)
+{
+	action_tab[i][tt]->type = ACT_SHFT;
+	action_tab[i][tt]->shift_to = to;
+}
+
+void set_reduce(size_t i, enum tk_type tt, struct sym_list *rf)
+{
+	action_tab[i][tt]->type = ACT_RED;
+	action_tab[i][tt]->reduce_to = "nt";
+	action_tab[i][tt]->reduce_from = rf;
+}
+
+void test_minimize_states()
+{
+	struct sym_list *p = NULL, *q = NULL;
+	add_sym_to_list(make_symbol(1, TK_ID, NULL), &p);
+	add_sym_to_list(make_symbol(1, TK_INT, NULL), &q);
+
+	/* 0 -a-> 1 -c-> 3 (reduce p on $)
+	 * 0 -b-> 2 -c-> 4 (reduce p on $)
+	 * 0 -nt-> 5 (accept)
+	 * 1, 2 and 3, 4 are equivalent.
+	 */
+	make_empty_tabs(6, 1);
+	set_shift(0, TK_LPAR, 1);
+	set_shift(0, TK_RPAR, 2);
+	set_shift(1, TK_CMPL, 3);
+	set_shift(2, TK_CMPL, 4);
+	set_reduce(3, EOI, p);
+	set_reduce(4, EOI, p);
+	goto_tab[0][0] = 5;
+	action_tab[5][EOI]->type = ACT_ACC;
+	minimize_states();
+	assert(canon_coll_n == 4);
+	assert(action_tab[0][TK_LPAR]->shift_to ==
+			action_tab[0][TK_RPAR]->shift_to);
+	size_t s1 = action_tab[0][TK_LPAR]->shift_to;
+	size_t s3 = action_tab[s1][TK_CMPL]->shift_to;
+	assert(action_tab[s3][EOI]->type == ACT_RED);
+	assert(action_tab[goto_tab[0][0]][EOI]->type == ACT_ACC);
+
+	/* same, but 4 reduces by q: nothing can be merged */
+	make_empty_tabs(6, 1);
+	set_shift(0, TK_LPAR, 1);
+	set_shift(0, TK_RPAR, 2);
+	set_shift(1, TK_CMPL, 3);
+	set_shift(2, TK_CMPL, 4);
+	set_reduce(3, EOI, p);
+	set_reduce(4, EOI, q);
+	goto_tab[0][0] = 5;
+	action_tab[5][EOI]->type = ACT_ACC;
+	minimize_states();
+	assert(canon_coll_n == 6);
+
+	/* minimizing the tables of a grammar keeps them valid */
+	init_lexer("./tests/arith_expr.bn");
+	parse_bn();
+	for (size_t i = 0; i < canon_coll_n; i++) {
+		for (enum tk_type tt = 0; tt < TK_TYPE_COUNT; tt++) {
+			struct action_entry *act = action_tab[i][tt];
+			if (act->type != ACT_SHFT) {
+				assert(canon_coll[i]->gt_term_rs[tt] == NULL);
+				continue;
+			}
+			assert(act->shift_to < canon_coll_n);
+			assert(canon_coll[i]->gt_term_rs[tt] ==
+						canon_coll[act->shift_to]);
+		}
+		for (size_t j = 0; j < nts_n; j++)
+			assert(goto_tab[i][j] <= canon_coll_n);
+	}
+
+	printf("%s passed\n", __func__);
+}
+
+/* Returns the number of states holding the complete item [ head -> ... . ] */
+size_t count_red_states(const char *head)
+{
+	size_t n = 0;
+	for (size_t i = 0; i < canon_coll_n; i++) {
+		struct itm_list *il = canon_coll[i];
+		for (; il != NULL; il = il->next) {
+			if (il->itm->dot == NULL &&
+					strcmp(il->itm->head, head) == 0) {
+				++n;
+				break;
+			}
+		}
+	}
+	return n;
+}
+
+void test_compute_lr1_coll()
+{
+	tab_kind = TAB_LR1;
+
+	/* an LALR(1) grammar gets as many states as with LALR(1) */
+	init_lexer("./tests/arith_expr.bn");
+	parse_bn();
+	assert(canon_coll_n == 16);
+	init_lexer("./tests/assign.bn");
+	parse_bn();
+	assert(canon_coll_n == 10);
+
+	/* an LR(1) grammar that is not LALR(1): [ E -> ~. ] and
+	 * [ F -> ~. ] must not be merged, the lookaheads for
+	 * E -> ~ are `)` after `(` and `+` after `*`.
+	 */
+	init_lexer("./tests/lr1_not_lalr.bn");
+	parse_bn();
+	assert(count_red_states("E") == 2);
+	assert(count_red_states("F") == 2);
+	for (size_t i = 0; i < canon_coll_n; i++) {
+		struct action_entry *rpar = action_tab[i][TK_RPAR];
+		struct action_entry *plus = action_tab[i][TK_PLUS];
+		if (rpar->type != ACT_RED || plus->type != ACT_RED)
+			continue;
+		assert(strcmp(rpar->reduce_to, plus->reduce_to) != 0);
+	}
+
+	tab_kind = TAB_SLR;
+	printf("%s passed\n", __func__);
+}
+
+void test_compute_term_classes()
+{
+	init_lexer("./tests/arith_expr.bn");
+	parse_bn();
+
+	/* ( ) + - * / TK_ID and $ differ, every other
+	 * terminal is in the class of errors.
+	 */
+	assert(term_classes_n == 9);
+	assert(term_class[TK_INT] == term_class[TK_STR]);
+	assert(term_class[TK_PLUS] != term_class[TK_MINUS]);
+	for (size_t i = 0; i < canon_coll_n; i++) {
+		assert(class_tab[i][term_class[TK_INT]]->type == ACT_ERR);
+		for (enum tk_type tt = 0; tt < TK_TYPE_COUNT; tt++) {
+			struct action_entry *a = action_tab[i][tt];
+			struct action_entry *c = class_tab[i][term_class[tt]];
+			assert(a->type == c->type);
+			if (a->type == ACT_SHFT)
+				assert(a->shift_to == c->shift_to);
+			if (a->type == ACT_RED)
+				assert(a->reduce_from == c->reduce_from);
+		}
+	}
+
+	/* only $ accepts */
+	assert(term_class[TK_RPAR] != term_class[EOI]);
+
+	printf("%s passed\n", __func__);
+}
+
+/* Checks that no two productions of a nonterminal begin with the same symbol. */
+void assert_left_factored()
+{
+	for (size_t p = 0; p < prods_n; p++)
+		for (size_t q = p + 1; q < nt_prods[prod_head[p] + 1]; q++)
+			assert(PROD_LEN(p) == 0 || PROD_LEN(q) == 0 ||
+				prod_syms[prod_off[p]] != prod_syms[prod_off[q]]);
+}
+
+void test_ll_transforms()
+{
+	init_lexer("./tests/arith_expr.bn");
+	parse_bn_ll();
+	assert(ll_conflicts == 0);
+	assert_left_factored();
+	/* no production begins with its head */
+	for (size_t p = 0; p < prods_n; p++)
+		assert(PROD_LEN(p) == 0 || prod_syms[prod_off[p]] !=
+					TK_TYPE_COUNT + prod_head[p]);
+	/* expr -> term expr_1, expr_1 -> + term expr_1 | - term expr_1 | `` */
+	struct prod_head_entry *phe = prods_of("expr_1");
+	size_t n = 0, empty = 0;
+	for (struct prod_list *pl = phe->prods; pl != NULL; pl = pl->next, n++)
+		empty += pl->prod->sym->is_term &&
+				pl->prod->sym->term_type == EMPTY_STR;
+	assert(n == 3 && empty == 1);
+	struct symbol e = {0, 0, "expr"};
+	size_t j = sym_index(&e) - TK_TYPE_COUNT;
+	assert(nt_prods[j+1] - nt_prods[j] == 1);
+	assert(ll_tab[j][TK_LPAR] == nt_prods[j]);
+	assert(ll_tab[j][TK_PLUS] == prods_n);
+
+	/* A -> id B | id becomes A -> id A_1, A_1 -> B | `` */
+	init_lexer("./tests/follow_cycle.bn");
+	parse_bn_ll();
+	assert(ll_conflicts == 0);
+	assert_left_factored();
+	phe = prods_of("A");
+	assert(phe->prods->next == NULL);
+	phe = prods_of("A_1");
+	assert(phe->prods->next != NULL && phe->prods->next->next == NULL);
+
+	/* S -> ( E ) | ( F + | ... is factored, but E and F both begin with ~ */
+	init_lexer("./tests/lr1_not_lalr.bn");
+	parse_bn_ll();
+	assert(ll_conflicts == 2);
+	assert_left_factored();
+
+	init_lexer("./tests/sample_grammar.bn");
+	parse_bn_ll();
+	assert(ll_conflicts == 0);
+	assert_left_factored();
+
+	/* B -> A becomes B -> B, a cycle, and A -> B | ( conflict on ( */
+	init_lexer("./tests/derives_itself.bn");
+	parse_bn_ll();
+	assert(ll_conflicts == 2);
+	for (size_t p = 0; p < prods_n; p++)
+		assert(PROD_LEN(p) == 0 || prod_syms[prod_off[p]] !=
+					TK_TYPE_COUNT + prod_head[p]);
+
+	printf("%s passed\n", __func__);
+}
+
 void test_grammar()
 {
 	test_sym_in_sym_list();
@@ -818,13 +1157,22 @@ void test_grammar()
 	test_first_for_terms();
 	test_compute_first_tab();
 	test_compute_follow_tab();
-	test_first_of_sym_list();
+	test_first_left_rec_nullable();
+	test_suffix_first();
+	test_follow_cycle();
+	test_first_of_suffix();
 	test_parse_bn();
 	test_print_item();
-	test_itm_in_itm_list();
 	test_closure();
-	test_find_itm_list_in_canon_set();
+	test_compute_clos_tab();
+	test_packed_items();
+	test_add_lr0_state();
 	test_go_to();
 	test_compute_canon_set();
 	test_compute_action_tab();
+	test_prec_decls();
+	test_minimize_states();
+	test_compute_lr1_coll();
+	test_compute_term_classes();
+	test_ll_transforms();
 }
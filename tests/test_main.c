@@ -1,4 +1,5 @@
 #include "test_grammar.c"
+#include "test_gen.c"
 #include "test_utils.c"
 
 #define ASCII_BOLD	"\033[1m"
@@ -14,4 +15,8 @@ int main()
 	printf(ASCII_BOLD"TEST_GRAMMAR\n"ASCII_NORMAL);
 	test_grammar();
 	printf(ASCII_BOLD ASCII_GREEN"passed\n\n"ASCII_NORMAL);
+
+	printf(ASCII_BOLD"TEST_GEN\n"ASCII_NORMAL);
+	test_gen();
+	printf(ASCII_BOLD ASCII_GREEN"passed\n\n"ASCII_NORMAL);
 }
@@ -49,46 +49,37 @@ void test_reverse_linked_list()
 	printf("%s passed\n", __func__);
 }
 
+struct _entry {
+	const char *key;
+	int ival;
+};
+HMAP(_entry_map, struct _entry);
+
 void test_LOOK_UP()
 {
-	struct _entry {
-		struct _entry *next;
-		const char *key;
-		int ival;
-	} *_tab[HASHSIZE];
-
-	for (int i = 0; i < HASHSIZE; i++)
-		_tab[i] = NULL;
+	union _entry_map _tab = {{NULL, 0, 0}};
 
 	struct _entry *dest;
 	LOOK_UP(dest, "key", _tab);
 	assert(dest == NULL);
 
 	struct _entry *ep = malloc(sizeof(struct _entry));
-	ep->next = NULL;
 	ep->key = "key";
 	ep->ival = 8;
-	unsigned int hash_val = hash(ep->key);
-	ep->next = _tab[hash_val];
-	_tab[hash_val] = ep;
+	hmap_insert(&_tab.m, ep->key, ep);
 
 	LOOK_UP(dest, "key", _tab);
 	assert(dest != NULL);
 	assert(dest->ival == 8);
+	LOOK_UP(dest, "kez", _tab);
+	assert(dest == NULL);
 
 	printf("%s passed\n", __func__);
 }
 
 void test_INSERT_ENTRY()
 {
-	struct _entry {
-		struct _entry *next;
-		const char *key;
-		int ival;
-	} *_tab[HASHSIZE];
-
-	for (int i = 0; i < HASHSIZE; i++)
-		_tab[i] = NULL;
+	union _entry_map _tab = {{NULL, 0, 0}};
 
 	struct _entry *e, *_e;
 	LOOK_UP(e, "key", _tab);
@@ -98,6 +89,129 @@ void test_INSERT_ENTRY()
 	INSERT_ENTRY(_e, "key", _tab);
 	LOOK_UP(e, "key", _tab);
 	assert(e != NULL);
+	assert(e == _e);
+
+	printf("%s passed\n", __func__);
+}
+
+void test_hmap_grow()
+{
+	struct hmap m = {NULL, 0, 0};
+	char keys[1000][8];
+	int vals[1000];
+	for (int i = 0; i < 1000; i++) {
+		sprintf(keys[i], "k%d", i);
+		vals[i] = i;
+		hmap_insert(&m, keys[i], &vals[i]);
+		assert(4 * m.n <= 3 * m.cap);
+	}
+	assert(m.n == 1000);
+	for (int i = 0; i < 1000; i++) {
+		int *v = hmap_get(&m, keys[i]);
+		assert(v != NULL && *v == i);
+		assert(m.slots[hmap_find(&m, keys[i])].val == v);
+	}
+	assert(hmap_get(&m, "k1000") == NULL);
+	assert(hmap_find(&m, "k1000") == m.cap);
+	hmap_clear(&m);
+	assert(m.n == 0 && hmap_get(&m, "k0") == NULL);
+
+	printf("%s passed\n", __func__);
+}
+
+void test_bitset()
+{
+	unsigned long *a = make_bitset(200), *b = make_bitset(200);
+	size_t words = BITSET_WORDS(200);
+	assert(words * WORD_BITS >= 200);
+
+	BIT_SET(a, 3);
+	BIT_SET(a, 150);
+	assert(BIT_TEST(a, 3));
+	assert(BIT_TEST(a, 150));
+	assert(!BIT_TEST(a, 4));
+	assert(!BIT_TEST(b, 150));
+	assert(!bitset_intersects(a, b, words));
+
+	BIT_SET(b, 150);
+	assert(bitset_intersects(a, b, words));
+	assert(bitset_or(b, a, words));
+	assert(BIT_TEST(b, 3));
+	assert(!bitset_or(b, a, words));
+
+	assert(bitset_count(b, words) == 2);
+	assert(bitset_next(b, words, 0) == 3);
+	assert(bitset_next(b, words, 4) == 150);
+	assert(bitset_next(b, words, 151) == words * WORD_BITS);
+
+	printf("%s passed\n", __func__);
+}
+
+void test_bitset_kernels()
+{
+	/* odd lengths leave words to the scalar tails */
+	for (size_t words = 1; words < 40; words += 3) {
+		unsigned long *a = make_bitset(words * WORD_BITS);
+		unsigned long *b = make_bitset(words * WORD_BITS);
+		unsigned long *c = make_bitset(words * WORD_BITS);
+		unsigned long *d = make_bitset(words * WORD_BITS);
+		for (size_t i = 0; i < words; i++) {
+			a[i] = c[i] = (unsigned long) rand();
+			b[i] = d[i] = (unsigned long) rand() << 7;
+		}
+		assert(bitset_count(a, words) == bitset_count_scalar(a, words));
+		assert(bitset_or(a, b, words) == bitset_or_scalar(c, d, words));
+		assert(memcmp(a, c, words * sizeof(unsigned long)) == 0);
+		assert(!bitset_or(a, b, words));
+
+		/* a change only in the last word is seen */
+		BIT_SET(b, words * WORD_BITS - 1);
+		a[words-1] &= ~(1UL << (WORD_BITS - 1));
+		assert(bitset_or(a, b, words));
+
+		size_t n = 0;
+		for (size_t i = bitset_next(a, words, 0); i < words * WORD_BITS;
+						i = bitset_next(a, words, i+1)) {
+			assert(BIT_TEST(a, i));
+			++n;
+		}
+		assert(n == bitset_count(a, words));
+		free_bitset(a, words * WORD_BITS);
+		free_bitset(b, words * WORD_BITS);
+		free_bitset(c, words * WORD_BITS);
+		free_bitset(d, words * WORD_BITS);
+	}
+
+	printf("%s passed\n", __func__);
+}
+
+void test_mem_stats()
+{
+	struct mem_stat st = mem_stats[MEM_STR], tot = mem_total;
+	reset_mem_peaks();
+
+	char *s = strdup("abc");
+	assert(mem_stats[MEM_STR].bytes == st.bytes + 4);
+	assert(mem_stats[MEM_STR].n == st.n + 1);
+	char *t = extended_str(s, "_s");
+	assert(strcmp(t, "abc_s") == 0);
+	assert(mem_stats[MEM_STR].bytes == st.bytes + 10);
+	mem_free(s, 4, MEM_STR);
+	mem_free(t, 6, MEM_STR);
+	assert(mem_stats[MEM_STR].bytes == st.bytes);
+	assert(mem_stats[MEM_STR].n == st.n);
+	assert(mem_stats[MEM_STR].peak_bytes == st.bytes + 10);
+	assert(mem_stats[MEM_STR].peak_n == st.n + 2);
+
+	unsigned long *bs = mem_realloc(NULL, 0, 8, MEM_BITSET);
+	bs = mem_realloc(bs, 8, 64, MEM_BITSET);
+	assert(mem_total.bytes == tot.bytes + 64);
+	assert(mem_total.n == tot.n + 1);
+	free_bitset(bs, 64 * CHAR_BIT);
+	assert(mem_total.bytes == tot.bytes);
+
+	reset_mem_peaks();
+	assert(mem_stats[MEM_STR].peak_bytes == st.bytes);
 
 	printf("%s passed\n", __func__);
 }
@@ -108,4 +222,8 @@ void test_utils()
 	test_reverse_linked_list();
 	test_LOOK_UP();
 	test_INSERT_ENTRY();
+	test_hmap_grow();
+	test_bitset();
+	test_bitset_kernels();
+	test_mem_stats();
 }
@@ -2,6 +2,7 @@
 
 #include <assert.h>
 #include <stddef.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -29,10 +30,103 @@ void *reverse_linked_list(void *llist)
 	return rl;
 }
 
+struct mem_stat mem_stats[MEM_TAG_COUNT], mem_total;
+
+const char *mem_tag_names[MEM_TAG_COUNT] = {
+	"symbol",	"sym_list",	"prod_list",
+	"item",		"itm_list",	"state",
+	"hmap",		"entry",	"action",
+	"str",		"bitset",	"table",
+	"scratch",
+};
+
+void count_alloc(struct mem_stat *st, size_t size, size_t n)
+{
+	st->bytes += size;
+	st->n += n;
+	if (st->bytes > st->peak_bytes)
+		st->peak_bytes = st->bytes;
+	if (st->n > st->peak_n)
+		st->peak_n = st->n;
+}
+
+void count_free(struct mem_stat *st, size_t size)
+{
+	assert(st->bytes >= size && st->n > 0);
+	st->bytes -= size;
+	--st->n;
+}
+
+void *mem_alloc(size_t size, enum mem_tag tag)
+{
+	void *p = malloc(size);
+	assert(p != NULL || size == 0);
+	count_alloc(&mem_stats[tag], size, 1);
+	count_alloc(&mem_total, size, 1);
+	return p;
+}
+
+void *mem_calloc(size_t n, size_t size, enum mem_tag tag)
+{
+	void *p = calloc(n, size);
+	assert(p != NULL || n == 0 || size == 0);
+	count_alloc(&mem_stats[tag], n * size, 1);
+	count_alloc(&mem_total, n * size, 1);
+	return p;
+}
+
+void *mem_realloc(void *p, size_t old_size, size_t size, enum mem_tag tag)
+{
+	if (p != NULL) {
+		count_free(&mem_stats[tag], old_size);
+		count_free(&mem_total, old_size);
+	}
+	p = realloc(p, size);
+	assert(p != NULL || size == 0);
+	count_alloc(&mem_stats[tag], size, 1);
+	count_alloc(&mem_total, size, 1);
+	return p;
+}
+
+void mem_free(void *p, size_t size, enum mem_tag tag)
+{
+	if (p == NULL)
+		return;
+	count_free(&mem_stats[tag], size);
+	count_free(&mem_total, size);
+	free(p);
+}
+
+void print_mem_stats(const char *phase)
+{
+	fprintf(stderr, "%-12s %14s %10s %14s %10s\n", phase,
+			"live bytes", "live n", "peak bytes", "peak n");
+	for (size_t t = 0; t < MEM_TAG_COUNT; t++) {
+		struct mem_stat *st = &mem_stats[t];
+		if (st->peak_n == 0)
+			continue;
+		fprintf(stderr, "  %-10s %14zu %10zu %14zu %10zu\n",
+				mem_tag_names[t], st->bytes, st->n,
+				st->peak_bytes, st->peak_n);
+	}
+	fprintf(stderr, "  %-10s %14zu %10zu %14zu %10zu\n", "total",
+			mem_total.bytes, mem_total.n,
+			mem_total.peak_bytes, mem_total.peak_n);
+}
+
+void reset_mem_peaks()
+{
+	for (size_t t = 0; t < MEM_TAG_COUNT; t++) {
+		mem_stats[t].peak_bytes = mem_stats[t].bytes;
+		mem_stats[t].peak_n = mem_stats[t].n;
+	}
+	mem_total.peak_bytes = mem_total.bytes;
+	mem_total.peak_n = mem_total.n;
+}
+
 char *strdup(const char *s)
 {
-	char *t = malloc((strlen(s) + 1) * sizeof(char));
-	assert(t != NULL);
+	char *t = mem_alloc((strlen(s) + 1) * sizeof(char), MEM_STR);
 	strcpy(t, s);
 	return t;
 }
@@ -41,7 +135,7 @@ char *extended_str(const char *base, const char *ext)
 {
 	assert(base != NULL);
 	assert(ext != NULL);
-	char *s = malloc(strlen(base) + strlen(ext));
+	char *s = mem_alloc(strlen(base) + strlen(ext) + 1, MEM_STR);
 	size_t i;
 	for (i = 0; base[i] != '\0'; i++)
 		s[i] = base[i];
@@ -51,16 +145,225 @@ char *extended_str(const char *base, const char *ext)
 	return s;
 }
 
+unsigned long *make_bitset(size_t nbits)
+{
+	return mem_calloc(BITSET_WORDS(nbits), sizeof(unsigned long),
+								MEM_BITSET);
+}
+
+void free_bitset(unsigned long *bs, size_t nbits)
+{
+	mem_free(bs, BITSET_WORDS(nbits) * sizeof(unsigned long), MEM_BITSET);
+}
+
+int bitset_or_scalar(unsigned long *dst, const unsigned long *src,
+							size_t words)
+{
+	unsigned long added = 0;
+	for (size_t i = 0; i < words; i++) {
+		added |= src[i] & ~dst[i];
+		dst[i] |= src[i];
+	}
+	return added != 0;
+}
+
+size_t bitset_count_scalar(const unsigned long *bs, size_t words)
+{
+	size_t n = 0;
+	for (size_t i = 0; i < words; i++)
+		for (unsigned long w = bs[i]; w != 0; w &= w - 1)
+			++n;
+	return n;
+}
+
+#ifdef BITSET_SIMD
+/*
+ * The vector kernels handle whole 16 or 32 byte blocks
+ * and leave the remaining words to the scalar loop.
+ */
+#define BLOCK_WORDS(BYTES)	((BYTES) / sizeof(unsigned long))
+
+__attribute__((target("sse2")))
+int bitset_or_sse2(unsigned long *dst, const unsigned long *src,
+							size_t words)
+{
+	__m128i added = _mm_setzero_si128();
+	size_t i = 0;
+	for (; i + BLOCK_WORDS(16) <= words; i += BLOCK_WORDS(16)) {
+		__m128i d = _mm_loadu_si128((const __m128i *) (dst + i));
+		__m128i s = _mm_loadu_si128((const __m128i *) (src + i));
+		added = _mm_or_si128(added, _mm_andnot_si128(d, s));
+		_mm_storeu_si128((__m128i *) (dst + i), _mm_or_si128(d, s));
+	}
+	int any = _mm_movemask_epi8(_mm_cmpeq_epi8(added,
+					_mm_setzero_si128())) != 0xffff;
+	return bitset_or_scalar(dst + i, src + i, words - i) | any;
+}
+
+__attribute__((target("avx2")))
+int bitset_or_avx2(unsigned long *dst, const unsigned long *src,
+							size_t words)
+{
+	__m256i added = _mm256_setzero_si256();
+	size_t i = 0;
+	for (; i + BLOCK_WORDS(32) <= words; i += BLOCK_WORDS(32)) {
+		__m256i d = _mm256_loadu_si256((const __m256i *) (dst + i));
+		__m256i s = _mm256_loadu_si256((const __m256i *) (src + i));
+		added = _mm256_or_si256(added, _mm256_andnot_si256(d, s));
+		_mm256_storeu_si256((__m256i *) (dst + i),
+						_mm256_or_si256(d, s));
+	}
+	int any = !_mm256_testz_si256(added, added);
+	return bitset_or_sse2(dst + i, src + i, words - i) | any;
+}
+
+__attribute__((target("popcnt")))
+size_t bitset_count_popcnt(const unsigned long *bs, size_t words)
+{
+	size_t n = 0;
+	for (size_t i = 0; i < words; i++)
+		n += (size_t) __builtin_popcountl(bs[i]);
+	return n;
+}
+#endif
+
+/*
+ * The kernels used by bitset_or() and bitset_count(),
+ * picked for the running CPU on their first call.
+ */
+int (*bitset_or_kernel)(unsigned long *, const unsigned long *, size_t);
+size_t (*bitset_count_kernel)(const unsigned long *, size_t);
+
+void pick_bitset_kernels()
+{
+	bitset_or_kernel = bitset_or_scalar;
+	bitset_count_kernel = bitset_count_scalar;
+#ifdef BITSET_SIMD
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		bitset_or_kernel = bitset_or_avx2;
+	else if (__builtin_cpu_supports("sse2"))
+		bitset_or_kernel = bitset_or_sse2;
+	if (__builtin_cpu_supports("popcnt"))
+		bitset_count_kernel = bitset_count_popcnt;
+#endif
+}
+
+int bitset_or(unsigned long *dst, const unsigned long *src, size_t words)
+{
+	if (bitset_or_kernel == NULL)
+		pick_bitset_kernels();
+	return bitset_or_kernel(dst, src, words);
+}
+
+size_t bitset_count(const unsigned long *bs, size_t words)
+{
+	if (bitset_count_kernel == NULL)
+		pick_bitset_kernels();
+	return bitset_count_kernel(bs, words);
+}
+
+size_t bitset_next(const unsigned long *bs, size_t words, size_t i)
+{
+	size_t w = i / WORD_BITS;
+	if (w >= words)
+		return words * WORD_BITS;
+	unsigned long rest = bs[w] & (~0UL << (i % WORD_BITS));
+	while (rest == 0) {
+		if (++w == words)
+			return words * WORD_BITS;
+		rest = bs[w];
+	}
+#ifdef __GNUC__
+	return w * WORD_BITS + (size_t) __builtin_ctzl(rest);
+#else
+	size_t b = 0;
+	for (; !(rest & 1UL); rest >>= 1)
+		++b;
+	return w * WORD_BITS + b;
+#endif
+}
+
+int bitset_intersects(const unsigned long *a, const unsigned long *b,
+							size_t words)
+{
+	for (size_t i = 0; i < words; i++)
+		if (a[i] & b[i])
+			return 1;
+	return 0;
+}
+
+/* FNV-1a */
 unsigned int hash(const char *s)
 {
 	assert(s != NULL);
-	unsigned int hash_val;
-	for (hash_val = 0; *s != '\0'; s++)
-		hash_val = (unsigned int) *s + 31*hash_val;
-	return hash_val % HASHSIZE;
+	unsigned int hash_val = 2166136261u;
+	for (; *s != '\0'; s++) {
+		hash_val ^= (unsigned char) *s;
+		hash_val *= 16777619u;
+	}
+	return hash_val;
 }
 
-struct entry {
-	struct entry *next;
-	const char *key;
-};
+#define HMAP_MIN_CAP	16
+
+size_t hmap_find(const struct hmap *m, const char *key)
+{
+	if (m->n == 0)
+		return m->cap;
+	unsigned int h = hash(key);
+	size_t mask = m->cap - 1;
+	for (size_t i = h & mask; m->slots[i].key != NULL; i = (i + 1) & mask)
+		if (m->slots[i].hash == h && strcmp(m->slots[i].key, key) == 0)
+			return i;
+	return m->cap;
+}
+
+void *hmap_get(const struct hmap *m, const char *key)
+{
+	size_t i = hmap_find(m, key);
+	return i == m->cap ? NULL : m->slots[i].val;
+}
+
+/* Places a slot whose key is not in m, without resizing. */
+void hmap_place(struct hmap *m, struct hmap_slot slot)
+{
+	size_t mask = m->cap - 1;
+	size_t i = slot.hash & mask;
+	while (m->slots[i].key != NULL)
+		i = (i + 1) & mask;
+	m->slots[i] = slot;
+}
+
+void hmap_grow(struct hmap *m)
+{
+	struct hmap_slot *old = m->slots;
+	size_t old_cap = m->cap;
+	m->cap = old_cap == 0 ? HMAP_MIN_CAP : 2 * old_cap;
+	m->slots = mem_calloc(m->cap, sizeof(struct hmap_slot), MEM_HMAP);
+	for (size_t i = 0; i < old_cap; i++)
+		if (old[i].key != NULL)
+			hmap_place(m, old[i]);
+	mem_free(old, old_cap * sizeof(struct hmap_slot), MEM_HMAP);
+}
+
+void hmap_insert(struct hmap *m, const char *key, void *val)
+{
+	assert(key != NULL);
+	if (4 * (m->n + 1) > 3 * m->cap)
+		hmap_grow(m);
+	unsigned int h = hash(key);
+	size_t mask = m->cap - 1;
+	size_t i = h & mask;
+	for (; m->slots[i].key != NULL; i = (i + 1) & mask)
+		assert(m->slots[i].hash != h ||
+				strcmp(m->slots[i].key, key) != 0);
+	m->slots[i] = (struct hmap_slot) {key, val, h};
+	++m->n;
+}
+
+void hmap_clear(struct hmap *m)
+{
+	mem_free(m->slots, m->cap * sizeof(struct hmap_slot), MEM_HMAP);
+	*m = (struct hmap) {NULL, 0, 0};
+}